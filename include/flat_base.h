@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Плоский формат файла базы транспортного каталога.
+// Файл состоит из заголовка, каталога разделов и самих разделов. Каждый раздел - массив записей
+// фиксированного размера (или байты), начало раздела выровнено по 8 байт, поэтому разделы
+// читаются прямо из отображённого в память файла без разбора. Числа хранятся в порядке байт
+// платформы, на которой создана база.
+namespace serialize::flat {
+
+// сигнатура в начале файла, по которой плоский формат отличается от protobuf
+inline constexpr std::string_view MAGIC{"TCFLAT\0\1", 8};
+inline constexpr uint32_t VERSION = 1;
+inline constexpr size_t ALIGNMENT = 8;
+
+enum class SectionType : uint32_t {
+    STRINGS = 1,            // имена остановок и маршрутов подряд (char)
+    STOPS = 2,              // Stop
+    ROUTES = 3,             // Route
+    ROUTE_STOPS = 4,        // номера остановок маршрутов подряд (uint32_t)
+    DISTANCES = 5,          // Distance
+    RENDER_SETTINGS = 6,    // настройки рендеринга (сообщение map_renderer_serialize.RenderSettings)
+    ROUTING_SETTINGS = 7,   // RoutingSettings
+    ROUTER_STOPS = 8,       // RouterStop
+    GRAPH_EDGES = 9,        // Edge
+    GRAPH_INCIDENCE = 10,   // номера исходящих рёбер вершин подряд (uint32_t)
+    GRAPH_OFFSETS = 11,     // начало списка рёбер вершины в GRAPH_INCIDENCE, vertex_count + 1 значений (uint32_t)
+    ROUTER_PREV_EDGES = 12, // таблица маршрутизатора vertex_count x vertex_count:
+                            // последнее ребро маршрута + 1, 0 - ребра нет (uint32_t)
+    RENDERED_MAP = 13,      // отрисованная карта (char)
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+};
+
+struct SectionEntry {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// строка в разделе STRINGS
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// проверяет, что строка ref лежит внутри раздела строк strings
+inline bool IsInside(StringRef ref, std::string_view strings) noexcept {
+    return ref.offset <= strings.size() && ref.length <= strings.size() - ref.offset;
+}
+
+struct Stop {
+    StringRef name;
+    double lat;
+    double lng;
+};
+
+struct Route {
+    StringRef name;
+    uint32_t type;          // transport_catalogue_serialize::RouteType
+    uint32_t first_stop;    // начало остановок маршрута в ROUTE_STOPS
+    uint32_t stop_count;
+    uint32_t reserved;
+};
+
+struct Distance {
+    uint32_t stop_from;
+    uint32_t stop_to;
+    int32_t distance;
+};
+
+struct RoutingSettings {
+    int32_t wait_time;
+    uint32_t reserved;
+    double velocity;
+};
+
+// вершина графа маршрутизатора и номер её остановки
+struct RouterStop {
+    uint32_t vertex;
+    uint32_t stop;
+};
+
+struct Edge {
+    uint32_t from;
+    uint32_t to;
+    uint32_t bus;           // номер маршрута
+    uint32_t span_count;
+    double total_time;
+};
+
+// Формирует файл базы из разделов
+class Writer {
+public:
+    void AddSection(SectionType type, std::string data);
+
+    template <typename Record>
+    void AddArray(SectionType type, const std::vector<Record> &records) {
+        static_assert(std::is_trivially_copyable_v<Record> && alignof(Record) <= ALIGNMENT);
+        AddSection(type, std::string(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record)));
+    }
+
+    // записывает заголовок, каталог и разделы в поток
+    bool Write(std::ostream &out) const;
+
+private:
+    std::vector<std::pair<SectionType, std::string>> sections_;
+};
+
+// Разделы файла, прочитанные из каталога разделов.
+// Разделы ссылаются на данные файла и действительны, пока файл открыт
+class Sections {
+public:
+    // разбирает заголовок и каталог разделов; возвращает nullopt, если данные - не база в плоском формате
+    // либо каталог разделов выходит за границы данных
+    static std::optional<Sections> Parse(std::string_view data);
+
+    // проверяет сигнатуру плоского формата
+    static bool IsFlat(std::string_view data) noexcept;
+
+    // байты раздела (пусто, если раздела нет)
+    std::string_view GetBytes(SectionType type) const;
+
+    // раздел как массив записей; возвращает false, если размер раздела не кратен размеру записи
+    template <typename Record>
+    bool GetArray(SectionType type, const Record *&records, size_t &count) const {
+        static_assert(std::is_trivially_copyable_v<Record> && alignof(Record) <= ALIGNMENT);
+        const auto bytes = GetBytes(type);
+        if (bytes.size() % sizeof(Record) != 0) {
+            return false;
+        }
+        records = reinterpret_cast<const Record*>(bytes.data());
+        count = bytes.size() / sizeof(Record);
+        return true;
+    }
+
+    bool Has(SectionType type) const;
+
+private:
+    std::unordered_map<uint32_t, std::string_view> sections_;
+};
+
+} // namespace serialize::flat
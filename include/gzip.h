@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+namespace gzip {
+
+// Ошибка сжатия (выбрасывается при сбоях zlib)
+class CompressionError : public std::runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+// Потоковое сжатие в формат gzip.
+// Данные принимаются частями и сжимаются по мере поступления, поэтому исходный текст
+// целиком в памяти не нужен: хранится только уже сжатый результат
+class Writer final {
+public:
+    // level - степень сжатия zlib от 1 (быстрее) до 9 (сильнее)
+    explicit Writer(int level);
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // сжимает очередную часть данных
+    void Write(std::string_view data);
+    // завершает поток и возвращает сжатые данные; после вызова запись невозможна
+    std::string Finish();
+
+private:
+    void Deflate(int flush);
+
+    z_stream stream_{};
+    std::string result_;
+    bool finished_ = false;
+};
+
+// возвращает данные в кодировке base64 (RFC 4648, с дополнением '=')
+std::string EncodeBase64(std::string_view data);
+
+} // namespace gzip
@@ -2,18 +2,23 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <variant>
 #include <vector>
 
+#include "number_format.h"
+
 namespace json {
 
 /*
  * Вспомогательная структура, хранящая контекст для вывода с отступами.
- * Хранит ссылку на поток вывода и шаг отступа при выводе элемента
+ * Хранит ссылку на поток вывода, шаг отступа при выводе элемента и формат вывода чисел.
+ * В компактном режиме значение выводится в одну строку без отступов и пробелов
  */
 struct RenderContext {
-    RenderContext(std::ostream &out, int indent = 0) : out(out), indent(indent) {}
+    RenderContext(std::ostream &out, int indent = 0, number_format::Settings number_format = {})
+        : out(out), indent(indent), number_format(number_format) {}
     void RenderIndent() const {
         for (int i = 0; i < indent; ++i) {
             out.put(' ');
@@ -21,6 +26,8 @@ struct RenderContext {
     }
     std::ostream &out;
     int indent = 0;
+    number_format::Settings number_format;
+    bool compact = false;
 };
 
 class Node;
@@ -33,7 +40,11 @@ public:
     using runtime_error::runtime_error;
 };
 
-using NodeData = std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string>;
+// Неизменяемая строка, которую ноды разделяют без копирования (например, отрисованная карта из кэша).
+// Нода с такой строкой считается строковой: IsString() и AsString() работают как для std::string
+using SharedString = std::shared_ptr<const std::string>;
+
+using NodeData = std::variant<std::nullptr_t, Array, Dict, bool, int, double, std::string, SharedString>;
 class Node final : private NodeData {
 public:
 
@@ -56,8 +67,12 @@ public:
     double AsDouble() const;
     const std::string& AsString() const;
 
+    // строки сравниваются по содержимому независимо от способа хранения
     friend bool operator==(const Node &lhs, const Node &rhs) {
-        return static_cast<NodeData>(lhs) == static_cast<NodeData>(rhs);
+        if (lhs.IsString() && rhs.IsString()) {
+            return lhs.AsString() == rhs.AsString();
+        }
+        return static_cast<const NodeData&>(lhs) == static_cast<const NodeData&>(rhs);
     }
     friend bool operator!=(const Node &lhs, const Node &rhs) {
         return !(lhs == rhs);
@@ -80,6 +95,8 @@ private:
 
 Document Load(std::istream& input);
 
-void Print(const Document& doc, std::ostream& output);
+void Print(const Document& doc, std::ostream& output, const number_format::Settings &number_format = {});
+// выводит значение в одну строку (например, для формата JSON Lines)
+void PrintCompact(const Node &node, std::ostream &output, const number_format::Settings &number_format = {});
 
 }  // namespace json
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <optional>
 
 #include "json_builder.h"
+#include "json_tape.h"
 #include "map_renderer.h"
+#include "parallel.h"
 #include "serialization.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
@@ -16,8 +20,20 @@ namespace json_reader {
 class JsonIO final {
 public:
 
+    // Режим разбора входных данных
+    enum class ParseMode {
+        DOM,    // полное построение дерева json::Node
+        LAZY,   // структурный индекс и чтение полей по запросу (json::LazyDocument)
+        REQUESTS, // ленивый режим, в котором разбираются только разделы, нужные для ответов на запросы
+                  // (serialization_settings, output_settings и stat_requests)
+        PARALLEL, // ленивый режим для загрузки базы: разделы настроек разбираются сразу,
+                  // а массив base_requests разбивается на части, которые разбираются параллельно
+    };
+
     // При создании считывает все данные из входного потока
-    JsonIO(std::istream &data_in);
+    // thread_count - число потоков для разбора base_requests в режиме PARALLEL
+    JsonIO(std::istream &data_in, ParseMode mode = ParseMode::DOM,
+           size_t thread_count = parallel::GetThreadCount());
 
     // Загружает данные об остановках и маршрутах в TransportCatalogue
     bool LoadData(transport_catalogue::TransportCatalogue &catalogue) const;
@@ -27,22 +43,71 @@ public:
     std::optional<serialize::Serializator::Settings> LoadSerializeSettings () const;
     // Загружает и возвращает настройки маршрутизации
     std::optional<transport_router::TransportRouter::RoutingSettings> LoadRoutingSettings() const;
+    // Загружает и возвращает формат вывода чисел в ответах (по умолчанию - совместимый с std::ostream)
+    number_format::Settings LoadNumberFormat() const;
+
+    // Статистика времени обработки запросов потока (память не зависит от длины потока)
+    struct StreamStats {
+        size_t count = 0;
+        uint64_t total_us = 0;
+        uint64_t max_us = 0;
+        // histogram[i] - число запросов с временем обработки меньше 2^i мкс (и не меньше 2^(i-1))
+        std::array<uint64_t, 40> histogram{};
+
+        void Add(uint64_t latency_us);
+        // верхняя граница времени обработки для доли запросов fraction (с точностью до степени двойки)
+        uint64_t Percentile(double fraction) const;
+    };
 
     // Отрабатывает запросы и записывает ответы в выходной поток
     void AnswerRequests(const transport_catalogue::TransportCatalogue &catalogue,
                         const renderer::RenderSettings &render_settings,
+                        renderer::MapRenderCache &map_cache,
                         transport_router::TransportRouter &router,
                         std::ostream &requests_out) const;
 
+    // Отрабатывает поток запросов в формате JSON Lines: один запрос на строку во входном потоке,
+    // ответ на каждую непустую строку выводится одной строкой в выходной поток.
+    // На некорректную строку выводится {"error_message":"invalid request"}.
+    // Выходной поток сбрасывается после каждых flush_batch ответов и в конце потока.
+    // Настройки вывода чисел берутся из основного документа
+    StreamStats AnswerRequestStream(const transport_catalogue::TransportCatalogue &catalogue,
+                                    const renderer::RenderSettings &render_settings,
+                                    renderer::MapRenderCache &map_cache,
+                                    transport_router::TransportRouter &router,
+                                    std::istream &requests_in,
+                                    std::ostream &answers_out,
+                                    size_t flush_batch = 1) const;
+
 private:
     // формирует настройки рендеринга
     renderer::RenderSettings LoadSettings(const json::Dict &data) const;
 
+    // возвращает раздел верхнего уровня документа либо nullptr, если его нет
+    // в ленивом режиме раздел материализуется в json::Node при первом обращении
+    const json::Node* GetSection(const std::string &name) const;
+
     // формирует и возвращает ответы на запросы
     json::Array LoadAnswers(const json::Array &requests,
                             const transport_catalogue::TransportCatalogue &catalogue,
                             const renderer::RenderSettings &render_settings,
-                            transport_router::TransportRouter &router) const;
+                            renderer::MapRenderCache &map_cache,
+                            transport_router::TransportRouter &router,
+                            const number_format::Settings &number_format) const;
+    // формирует ответы на запросы, читая только нужные поля из ленивого документа
+    json::Array LoadAnswers(const json::LazyNode &requests,
+                            const transport_catalogue::TransportCatalogue &catalogue,
+                            const renderer::RenderSettings &render_settings,
+                            renderer::MapRenderCache &map_cache,
+                            transport_router::TransportRouter &router,
+                            const number_format::Settings &number_format) const;
+    // формирует ответ на один запрос из ленивого документа (null - запрос некорректен)
+    json::Node LoadAnswer(const json::LazyNode &request,
+                                         const transport_catalogue::TransportCatalogue &catalogue,
+                                         const renderer::RenderSettings &render_settings,
+                                         renderer::MapRenderCache &map_cache,
+                                         transport_router::TransportRouter &router,
+                                         const number_format::Settings &number_format) const;
 
     // загрузка данных из json в каталог
     static void LoadStops(const json::Array &data, transport_catalogue::TransportCatalogue &catalogue);
@@ -50,19 +115,39 @@ private:
     static void LoadDistances(const json::Array &data, transport_catalogue::TransportCatalogue &catalogue);
 
     // возвращает ответ на запрос инфромации о маршруте
-    static json::Dict LoadRouteAnswer(const json::Dict &request,
+    static json::Dict LoadRouteAnswer(int id, const std::string &name,
                                const transport_catalogue::TransportCatalogue &catalogue);
     // возвращает ответ на запрос инфромации об остановке
-    static json::Dict LoadStopAnswer(const json::Dict &request,
+    static json::Dict LoadStopAnswer(int id, const std::string &name,
                                const transport_catalogue::TransportCatalogue &catalogue);
     // возвращает ответ на запрос построения карты маршрутов
-    static json::Dict LoadMapAnswer(const json::Dict &request,
+    // карта берётся из кэша, если он построен для того же каталога и настроек
+    static json::Dict LoadMapAnswer(int id,
                              const transport_catalogue::TransportCatalogue &catalogue,
-                             const renderer::RenderSettings &render_settings);
+                             const renderer::RenderSettings &render_settings,
+                             renderer::MapRenderCache &map_cache,
+                             const number_format::Settings &number_format);
+    // возвращает ответ на запрос отрисовки области карты: тайла z/x/y или прямоугольника bbox
+    // в координатах полной карты
+    static json::Dict LoadMapTileAnswer(const json::Dict &request,
+                                        const transport_catalogue::TransportCatalogue &catalogue,
+                                        const renderer::RenderSettings &render_settings,
+                                        renderer::MapRenderCache &map_cache,
+                                        const number_format::Settings &number_format);
     // возвращает ответ на запрос построения маршрута
-    json::Dict LoadRouteBuildAnswer(const json::Dict &request,
+    json::Dict LoadRouteBuildAnswer(int id, const std::string &from, const std::string &to,
                                     const transport_catalogue::TransportCatalogue &catalogue,
                                     transport_router::TransportRouter &router) const;
+    // возвращает ответ на запрос построения маршрута вместе с картой, на которой выделена поездка
+    json::Dict LoadRouteMapAnswer(int id, const std::string &from, const std::string &to,
+                                  const transport_catalogue::TransportCatalogue &catalogue,
+                                  const renderer::RenderSettings &render_settings,
+                                  renderer::MapRenderCache &map_cache,
+                                  transport_router::TransportRouter &router,
+                                  const number_format::Settings &number_format) const;
+    // формирует ответ с элементами построенного маршрута
+    static json::Dict MakeRouteBuildAnswer(int id, const transport_router::TransportRouter::TransportRoute &route,
+                                           int wait_time);
     // возвращает сообщение с ошибкой о запросе с некорректным именем автобуса или маршрута
     static json::Dict ErrorMessage(int id);
     // проверяет, что внутри ноды записаны валидные данные остановки
@@ -75,15 +160,30 @@ private:
     static bool IsStopRequest(const json::Node &node);
     // проверяет, что внутри ноды записан валидный запрос карты маршрутов
     static bool IsMapRequest(const json::Node &node);
+    // проверяет, что внутри ноды записан валидный запрос области карты
+    static bool IsMapTileRequest(const json::Node &node);
     // проверяет, что внутри ноды записан валидный запрос посторения маршрута
-    static bool IsRouteBuildRequest(const json::Node &node);
+    // (type - тип запроса, у запроса карты с маршрутом те же поля)
+    static bool IsRouteBuildRequest(const json::Node &node, const std::string &type = "Route");
+    // проверяет, что внутри ноды записан валидный запрос карты с выделенным маршрутом
+    static bool IsRouteMapRequest(const json::Node &node);
 
     // считывает значение цвета из ноды
     static svg::Color ReadColor(const json::Node &node);
     // считывает пару значений (offset) из ноды
     static svg::Point ReadOffset(const json::Array &node);
+    // возвращает строковое поле ленивого словаря, если оно есть
+    static std::optional<std::string> ReadString(const json::LazyNode &node, std::string_view key);
 
-    json::Document data_;
+    json::Document data_{json::Node{}};
+    std::optional<json::LazyDocument> lazy_data_;
+    // разделы, материализованные из ленивого документа
+    mutable std::map<std::string, json::Node> sections_;
+    // число потоков для разбора отложенных массивов (1 - последовательный разбор)
+    size_t thread_count_ = 1;
 };
 
+// выводит сводку статистики: число запросов, среднее, p50, p99 и максимальное время обработки
+std::ostream& operator<<(std::ostream &out, const JsonIO::StreamStats &stats);
+
 } // namespace json_reader
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+namespace json {
+
+/*
+ * Ленивое представление JSON-документа ("лента", по мотивам simdjson).
+ * Разбор выполняется в два этапа:
+ *  1. структурный индекс - поиск позиций кавычек и символов {}[]:, вне строк
+ *     (с использованием SIMD при наличии AVX2/SSE, иначе скалярно);
+ *  2. построение ленты - плоского массива значений с указанием их границ в тексте.
+ * Значения (строки, числа) преобразуются только при обращении к ним,
+ * объекты json::Node не создаются.
+ */
+class LazyNode;
+
+class LazyDocument final {
+public:
+    // принимает текст документа во владение и строит по нему ленту
+    // если задан root_keys, то разбираются только перечисленные разделы корневого словаря,
+    // остальные пропускаются по структурному индексу и попадают в ленту необработанным текстом (IsRaw)
+    // при ошибках разбора выбрасывает json::ParsingError
+    explicit LazyDocument(std::string text, std::vector<std::string> root_keys = {});
+
+    LazyNode GetRoot() const;
+
+private:
+    friend class LazyNode;
+
+    enum class Type : uint8_t {
+        NUL,
+        BOOL,
+        NUMBER,
+        STRING,
+        ARRAY,
+        DICT,
+        RAW,    // пропущенное при построении ленты значение
+    };
+
+    // элемент ленты
+    struct Entry {
+        Type type;
+        uint32_t begin = 0; // начало значения в тексте (для строк - после открывающей кавычки)
+        uint32_t end = 0;   // конец значения в тексте (для строк - позиция закрывающей кавычки)
+        uint32_t next = 0;  // индекс следующего за значением (и всеми вложенными) элемента ленты
+    };
+
+    void BuildTape(const std::vector<uint32_t> &structurals, const std::vector<std::string> &root_keys);
+
+    std::string text_;
+    std::vector<Entry> tape_;
+};
+
+// Этап 1: возвращает позиции неэкранированных кавычек и символов {}[]:, вне строк
+std::vector<uint32_t> FindStructurals(std::string_view text);
+
+// Легковесная ссылка на значение внутри LazyDocument.
+// Действительна, пока жив документ
+class LazyNode final {
+public:
+    class Iterator;
+
+    bool IsNull() const noexcept;
+    bool IsBool() const noexcept;
+    bool IsInt() const noexcept;
+    bool IsDouble() const noexcept;
+    bool IsPureDouble() const noexcept;
+    bool IsString() const noexcept;
+    bool IsArray() const noexcept;
+    bool IsMap() const noexcept;
+    // значение пропущено при построении ленты и хранится необработанным текстом
+    bool IsRaw() const noexcept;
+
+    // возвращают значение, преобразуя текст по запросу
+    // при несоответствии типа выбрасывают std::logic_error
+    bool AsBool() const;
+    int AsInt() const;
+    double AsDouble() const;
+    std::string AsString() const;
+    // исходный текст пропущенного значения
+    std::string_view AsRawText() const;
+
+    // ищет значение по ключу в словаре
+    std::optional<LazyNode> Find(std::string_view key) const;
+    // возвращает значение по ключу, если ключа нет - выбрасывает std::out_of_range
+    LazyNode At(std::string_view key) const;
+
+    // перебор элементов массива
+    Iterator begin() const;
+    Iterator end() const;
+
+    // строит полноценный json::Node по поддереву (для совместимости с DOM-кодом)
+    // пропущенные значения при этом разбираются из исходного текста
+    Node Materialize() const;
+
+private:
+    friend class LazyDocument;
+
+    LazyNode(const LazyDocument *document, uint32_t index)
+        : document_(document)
+        , index_(index) {
+    }
+
+    const LazyDocument::Entry& GetEntry() const;
+    std::string_view GetText() const;
+    // проверяет, что ключ словаря совпадает с key (без лишних копирований)
+    bool KeyEquals(std::string_view key) const;
+
+    const LazyDocument *document_ = nullptr;
+    uint32_t index_ = 0;
+};
+
+class LazyNode::Iterator final {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = LazyNode;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const LazyNode*;
+    using reference = LazyNode;
+
+    LazyNode operator*() const {
+        return {document_, index_};
+    }
+    Iterator& operator++();
+    bool operator==(const Iterator &other) const {
+        return index_ == other.index_;
+    }
+    bool operator!=(const Iterator &other) const {
+        return !(*this == other);
+    }
+
+private:
+    friend class LazyNode;
+
+    Iterator(const LazyDocument *document, uint32_t index)
+        : document_(document)
+        , index_(index) {
+    }
+
+    const LazyDocument *document_ = nullptr;
+    uint32_t index_ = 0;
+};
+
+// считывает весь поток и строит по нему ленивый документ
+LazyDocument LoadLazy(std::istream &input, std::vector<std::string> root_keys = {});
+
+// Разбирает текст JSON-массива на thread_count потоках:
+// по структурному индексу текст делится на части примерно равного размера по запятым между элементами,
+// части разбираются параллельно и объединяются в исходном порядке.
+// Если текст - не массив, он разбирается целиком в вызывающем потоке
+Node LoadArrayParallel(std::string_view text, size_t thread_count);
+
+} // namespace json
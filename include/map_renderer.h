@@ -1,12 +1,17 @@
 #pragma once
 
 #include <cmath>
-#include <map>
-#include <set>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "domain.h"
+#include "parallel.h"
 #include "svg.h"
 #include "transport_catalogue.h"
 
@@ -31,29 +36,117 @@ struct RenderSettings {
     double underlayer_width = 0.0;
 
     std::vector<svg::Color> color_palette;
+
+    // подложка, приглушающая карту под поездкой в ответах RouteMap (должна быть полупрозрачной)
+    svg::Color veil_color = svg::Rgba{255, 255, 255, 0.6};
+
+    // компактный вывод: оформление задаётся таблицей стилей, значки остановок - через <use>,
+    // координаты округляются до coordinate_precision знаков после запятой
+    bool compact = false;
+    int coordinate_precision = 2;
+
+    // допустимое отклонение упрощённых линий маршрутов в пикселях вывода (0 - без упрощения)
+    double simplify_tolerance = 0.0;
+
+    // степень сжатия карты в формат gzip (svgz) от 1 до 9; 0 - карта выводится без сжатия
+    int compression_level = 0;
+};
+
+// Упрощение ломаных по алгоритму Дугласа-Пекера для всех допусков сразу.
+// Возвращает вес каждой вершины: вершина остаётся в ломаной, упрощённой с допуском tolerance,
+// тогда и только тогда, когда её вес больше tolerance. У концевых вершин вес бесконечен.
+// Каждая отброшенная вершина лежит не дальше tolerance от отрезка упрощённой ломаной,
+// который её заменяет, поэтому контур линии смещается не больше чем на tolerance
+std::vector<double> ComputeSimplificationWeights(const std::vector<svg::Point> &points);
+bool operator==(const RenderSettings &lhs, const RenderSettings &rhs);
+bool operator!=(const RenderSettings &lhs, const RenderSettings &rhs);
+
+// Модель карты: спроецированные на карту остановки и порядок вывода маршрутов и остановок.
+// Строится один раз для каталога и настроек, повторные отрисовки обходятся без проецирования и сортировки
+struct RenderModel {
+    struct Stop {
+        std::string_view name;
+        svg::Point point;
+    };
+    struct Route {
+        std::string_view name;
+        domain::RouteType route_type;
+        // номера остановок маршрута в stops
+        std::vector<uint32_t> stops;
+    };
+
+    // остановки, через которые проходят маршруты, в порядке имён
+    std::vector<Stop> stops;
+    // непустые маршруты в порядке имён: номер маршрута в списке - номер его цвета
+    std::vector<Route> routes;
+};
+
+// Участок поездки для отрисовки поверх карты: проезд на автобусе bus от stop_from до stop_to
+// через span_count перегонов
+struct RideSegment {
+    std::string_view bus;
+    std::string_view stop_from;
+    std::string_view stop_to;
+    int span_count = 0;
 };
 
 // класс для отрисовки маршрутов в формате svg
 class MapRenderer final {
+    friend class MapTileIndex;
 public:
-    using Routes = std::map<std::string_view, const domain::Route*>;
-    using Stops = std::map<std::string_view, const domain::Stop*>;
-    using BusesOnStops = std::unordered_map<std::string_view, std::set<std::string_view>>;
-
     void SetSettings(const RenderSettings &settings);
 
+    // строит модель карты по каталогу (проекция зависит от размеров и отступов из настроек)
+    RenderModel BuildModel(const transport_catalogue::TransportCatalogue &catalogue);
+
     svg::Document RenderMap(const transport_catalogue::TransportCatalogue &catalogue);
+    svg::Document RenderMap(const RenderModel &model) const;
+
+    // Дописывает SVG-текст карты в конец строки.
+    // Слои (линии, названия маршрутов, остановки, названия остановок) делятся на части,
+    // которые строятся и выводятся в отдельные буферы на thread_count потоках,
+    // после чего буферы склеиваются в порядке слоёв. Результат совпадает с RenderMap(model).Render(out)
+    void RenderMap(const RenderModel &model, std::string &out,
+                   const number_format::Settings &number_format = {},
+                   size_t thread_count = parallel::GetThreadCount()) const;
+    // Передаёт SVG-текст карты по частям в sink в порядке вывода. При thread_count <= 1 части
+    // отрисовываются по одной в общий буфер, так что полный текст карты в памяти не собирается.
+    // Склеенные части совпадают с RenderMap(model).Render(out)
+    void RenderMap(const RenderModel &model, const std::function<void(std::string_view)> &sink,
+                   const number_format::Settings &number_format = {},
+                   size_t thread_count = parallel::GetThreadCount()) const;
+
+    // Выводит в документ слой поездки: приглушающую карту подложку во весь холст, участки маршрутов
+    // поездки, остановки на них и названия остановок посадки и высадки.
+    // Время работы пропорционально длине маршрутов поездки и не зависит от размера сети
+    void RenderRideOverlay(svg::Document &doc, const RenderModel &model, const std::vector<RideSegment> &ride) const;
 
 private:
-    void RenderLines(svg::Document &doc, const Routes &routes) const;
-    void RenderRouteNames(svg::Document &doc, const Routes &routes) const;
-    void RenderStops(svg::Document &doc, const Stops &stops, const BusesOnStops &buses_on_stops) const;
-    void RenderStopNames(svg::Document &doc, const Stops &stops, const BusesOnStops &buses_on_stops) const;
+    // выводят в документ часть слоя: маршруты или остановки модели с номерами из [begin, end)
+    void RenderLines(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const;
+    void RenderRouteNames(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const;
+    void RenderStops(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const;
+    void RenderStopNames(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const;
+
+    // добавляют в документ элементы карты в обычном или компактном оформлении
+    // color_index - номер маршрута среди непустых маршрутов в порядке имён
+    void AddLine(svg::Document &doc, const std::vector<svg::Point> &points, size_t color_index) const;
+    void AddRouteLabel(svg::Document &doc, std::string_view name, svg::Point pos, size_t color_index) const;
+    void AddStop(svg::Document &doc, svg::Point pos) const;
+    // номер цвета маршрута в палитре; при пустой палитре (например, в базе без настроек рендеринга)
+    // возвращается 0, а цвет маршрута не задаётся
+    size_t GetPaletteIndex(size_t color_index) const;
+    void AddStopLabel(svg::Document &doc, std::string_view name, svg::Point pos) const;
+
+    // компактный режим: таблица стилей и определение значка остановки
+    void RenderCompactStyle(svg::Document &doc) const;
+    // округляет координаты точки до заданной в настройках точности
+    svg::Point Quantize(svg::Point point) const;
 
     // возвращает пару - минимальная и максимальная координаты прямоугольника,
     // в который вписаны все остановки на маршрутах
     std::pair<geo::Coordinates, geo::Coordinates>
-    ComputeFieldSize(const transport_catalogue::TransportCatalogue &catalogue) const;
+    ComputeFieldSize(const std::vector<const domain::Stop*> &stops) const;
 
     // пересчитывает широту и долготу в координаты для рисования на карте
     svg::Point GetRelativePoint(geo::Coordinates coordinate) const;
@@ -63,6 +156,140 @@ private:
 
 };
 
+// Прямоугольная область карты в координатах полной карты
+struct Viewport {
+    svg::Point min;
+    svg::Point max;
+};
+
+// Возвращает область тайла z/x/y: на уровне z полная карта размером settings.size
+// делится на 2^z x 2^z тайлов, нумерация x и y идёт от левого верхнего угла.
+// При номерах вне сетки возвращает nullopt
+std::optional<Viewport> GetTileViewport(const RenderSettings &settings, int z, int x, int y);
+
+// Пространственный индекс карты для отрисовки её части.
+// Хранит спроецированные на полную карту остановки и отрезки маршрутов в равномерной сетке ячеек,
+// поэтому отрисовка области обходит только ячейки, пересекающие её, и объекты в них.
+// Область растягивается до размера settings.size с сохранением пропорций; толщины линий,
+// радиусы и шрифты не масштабируются. Порядок слоёв и цвета маршрутов совпадают с полной картой.
+// Подпись попадает в область, если её оценочный прямоугольник (ширина символа не больше кегля)
+// пересекает область
+class MapTileIndex final {
+public:
+    MapTileIndex(const RenderModel &model, const RenderSettings &settings);
+
+    svg::Document RenderTile(const Viewport &viewport) const;
+
+private:
+    struct RouteData {
+        std::string_view name;
+        // точки обхода маршрута (для некольцевого без упрощения - туда и обратно)
+        std::vector<svg::Point> points;
+        // веса вершин для упрощения линий (пусто, если упрощение выключено)
+        std::vector<double> weights;
+    };
+    struct StopData {
+        std::string_view name;
+        svg::Point point;
+        // подписи маршрутов у остановки: номер маршрута * 2 + номер конечной
+        std::vector<uint32_t> route_labels;
+    };
+    // отрезок points[segment], points[segment + 1] маршрута route
+    struct SegmentRef {
+        uint32_t route;
+        uint32_t segment;
+    };
+
+    size_t GetSegmentCount(const RouteData &route) const;
+    // диапазон ячеек сетки, пересекающих прямоугольник [min, max]
+    std::pair<std::pair<size_t, size_t>, std::pair<size_t, size_t>> GetCellRange(svg::Point min, svg::Point max) const;
+
+    MapRenderer renderer_;
+    std::vector<RouteData> routes_;
+    std::vector<StopData> stops_;
+
+    svg::Point grid_min_;
+    double cell_size_ = 1.0;
+    size_t grid_width_ = 1;
+    size_t grid_height_ = 1;
+    std::vector<std::vector<uint32_t>> stop_cells_;
+    std::vector<std::vector<SegmentRef>> segment_cells_;
+    // наибольшее удаление видимой части значка или подписи остановки от её точки (в пикселях тайла)
+    double stop_margin_ = 0.0;
+};
+
+// Кэш отрисованной карты.
+// Хранит SVG-текст последней отрисованной карты вместе с ключом: каталогом и его версией,
+// настройками рендеринга и форматом чисел. Запрос с тем же ключом возвращает сохранённый текст
+// без повторного построения документа
+class MapRenderCache final {
+public:
+    // возвращает SVG-текст карты, отрисовывая её заново, если ключ не совпадает с сохранённым
+    // текст разделяется без копирования и остаётся действительным после изменения кэша
+    std::shared_ptr<const std::string> GetMap(const transport_catalogue::TransportCatalogue &catalogue,
+                              const RenderSettings &settings,
+                              const number_format::Settings &number_format = {});
+
+    // возвращает SVG-текст области карты; пространственный индекс строится при первом запросе
+    // и перестраивается при изменении каталога или настроек
+    std::string GetTile(const transport_catalogue::TransportCatalogue &catalogue,
+                        const RenderSettings &settings,
+                        const Viewport &viewport,
+                        const number_format::Settings &number_format = {});
+
+    // возвращает SVG-текст карты с выделенной поездкой: к сохранённой в кэше карте без закрывающего тега
+    // дописывается только слой поездки
+    std::string GetRouteMap(const transport_catalogue::TransportCatalogue &catalogue,
+                            const RenderSettings &settings,
+                            const std::vector<RideSegment> &ride,
+                            const number_format::Settings &number_format = {});
+
+    // сохраняет заранее отрисованную карту (например, загруженную из базы) для текущей версии каталога
+    void Store(const transport_catalogue::TransportCatalogue &catalogue,
+               const RenderSettings &settings,
+               const number_format::Settings &number_format,
+               std::string map);
+    // сохраняет карту, которая загружается вызовом loader при первом обращении к ней
+    void Store(const transport_catalogue::TransportCatalogue &catalogue,
+               const RenderSettings &settings,
+               const number_format::Settings &number_format,
+               std::function<std::string()> loader);
+
+private:
+    // отрисованная карта и ключ, для которого она построена
+    struct MapEntry {
+        const transport_catalogue::TransportCatalogue *catalogue = nullptr;
+        uint64_t version = 0;
+        RenderSettings settings;
+        number_format::Settings number_format;
+        std::shared_ptr<const std::string> map;
+        // загружает карту, если она ещё не получена
+        std::function<std::string()> loader;
+
+        bool IsActual(const transport_catalogue::TransportCatalogue &catalogue,
+                      const RenderSettings &settings,
+                      const number_format::Settings &number_format) const;
+    };
+
+    // возвращает запись для карты без сжатия или сжатой карты
+    MapEntry& GetEntry(const RenderSettings &settings);
+    // возвращает модель карты, перестраивая её при изменении каталога или настроек
+    const RenderModel& GetModel(const transport_catalogue::TransportCatalogue &catalogue,
+                                const RenderSettings &settings);
+
+    // несжатая карта нужна и для ответов с выделенной поездкой,
+    // поэтому она хранится отдельно от сжатой и не вытесняет её
+    MapEntry plain_map_;
+    MapEntry compressed_map_;
+
+    // модель карты и пространственный индекс для текущих каталога и настроек
+    const transport_catalogue::TransportCatalogue *model_catalogue_ = nullptr;
+    uint64_t model_version_ = 0;
+    RenderSettings model_settings_;
+    std::optional<RenderModel> model_;
+    std::optional<MapTileIndex> index_;
+};
+
 } // namespace renderer
 
 
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mapped_file {
+
+// Файл, отображённый в память только для чтения.
+// Страницы файла подгружаются системой по мере обращения, поэтому открытие не зависит от размера файла.
+// Там, где отображение недоступно, файл целиком читается в память
+class MappedFile final {
+public:
+    // отображает файл в память; возвращает nullptr, если файл не удалось открыть
+    static std::shared_ptr<const MappedFile> Open(const std::filesystem::path &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // содержимое файла (начало выровнено не хуже, чем по 8 байт)
+    std::string_view GetData() const noexcept;
+
+private:
+    MappedFile() = default;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    // содержимое файла, если отображение недоступно
+    std::string buffer_;
+};
+
+} // namespace mapped_file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace number_format {
+
+// Способ вывода чисел с плавающей точкой
+enum class Mode {
+    COMPATIBLE, // как у std::ostream по умолчанию (%g, 6 значащих цифр)
+    SHORTEST,   // кратчайшее представление, по которому значение восстанавливается без потерь
+    FIXED,      // заданное количество знаков после запятой, незначащие нули отбрасываются
+};
+
+struct Settings {
+    Mode mode = Mode::COMPATIBLE;
+    int precision = 6;  // значащие цифры для COMPATIBLE, знаки после запятой для FIXED
+
+    friend bool operator==(const Settings &lhs, const Settings &rhs) {
+        return lhs.mode == rhs.mode && lhs.precision == rhs.precision;
+    }
+    friend bool operator!=(const Settings &lhs, const Settings &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+// размер буфера, достаточный для любого результата Write
+constexpr size_t BUFFER_SIZE = 512;
+
+// записывает число в буфер [first, last) без использования локали и состояния потока,
+// возвращает указатель на конец записанного
+char* Write(char *first, char *last, double value, const Settings &settings = {});
+char* Write(char *first, char *last, int value);
+
+// выводит число в поток
+void Print(std::ostream &out, double value, const Settings &settings = {});
+void Print(std::ostream &out, int value);
+
+// дописывает число в конец строки
+void Append(std::string &out, double value, const Settings &settings = {});
+void Append(std::string &out, int value);
+
+// обёртка для вывода числа с заданными настройками оператором <<
+struct Formatted {
+    double value;
+    const Settings &settings;
+};
+std::ostream& operator<<(std::ostream &out, Formatted number);
+
+} // namespace number_format
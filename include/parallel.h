@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// количество рабочих потоков по умолчанию (не меньше одного)
+inline size_t GetThreadCount() {
+    const size_t count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+// Пул потоков, общий для всех вызовов For. Потоки создаются при первой надобности и живут
+// до завершения программы, поэтому частые вызовы For (например, для каждой порции базы
+// потокового формата) не платят за создание и завершение потоков.
+// Пул выполняет одну работу за раз
+class ThreadPool {
+public:
+    static ThreadPool& Shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard guard(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // выполняет work в вызывающем потоке и одновременно не больше чем на helper_count потоках пула
+    // и дожидается завершения всех копий; work не должна выбрасывать исключения.
+    // Возвращает false и не запускает work, если пул занят (вложенный вызов или вызов из другого потока)
+    bool Run(const std::function<void()> &work, size_t helper_count) {
+        std::unique_lock run_lock(run_mutex_, std::try_to_lock);
+        if (!run_lock) {
+            return false;
+        }
+        {
+            std::lock_guard guard(mutex_);
+            while (threads_.size() < helper_count) {
+                threads_.emplace_back([this] {
+                    WorkerLoop();
+                });
+            }
+            work_ = &work;
+            slots_ = helper_count;
+        }
+        wake_.notify_all();
+        work();
+
+        std::unique_lock lock(mutex_);
+        // потоки, ещё не взявшие работу, к ней уже не присоединяются
+        slots_ = 0;
+        done_.wait(lock, [this] {
+            return active_ == 0;
+        });
+        work_ = nullptr;
+        return true;
+    }
+
+private:
+    ThreadPool() = default;
+
+    void WorkerLoop() {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] {
+                return stop_ || slots_ > 0;
+            });
+            if (stop_) {
+                return;
+            }
+            --slots_;
+            ++active_;
+            const auto *work = work_;
+            lock.unlock();
+            (*work)();
+            lock.lock();
+            if (--active_ == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::vector<std::thread> threads_;
+    const std::function<void()> *work_ = nullptr;
+    // сколько потоков ещё может взять текущую работу и сколько её выполняют
+    size_t slots_ = 0;
+    size_t active_ = 0;
+    bool stop_ = false;
+};
+
+// Выполняет func(index) для каждого index из [0, count) в вызывающем потоке и thread_count - 1
+// потоках общего пула. Задачи раздаются по одной через общий счётчик, поэтому неравные по объёму
+// задачи распределяются между потоками равномерно. Если пул занят (вложенный вызов For),
+// задачи выполняются в вызывающем потоке.
+// Первое выброшенное задачей исключение пробрасывается в вызывающий поток
+// после завершения всех потоков, оставшиеся задачи при этом не запускаются
+template <typename Func>
+void For(size_t count, Func func, size_t thread_count = GetThreadCount()) {
+    thread_count = std::min(thread_count, count);
+    if (thread_count <= 1) {
+        for (size_t index = 0; index < count; ++index) {
+            func(index);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next_index{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        for (size_t index = next_index++; index < count && !failed; index = next_index++) {
+            try {
+                func(index);
+            } catch (...) {
+                std::lock_guard guard(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    // вызывающий поток тоже участвует в работе
+    if (!ThreadPool::Shared().Run(worker, thread_count - 1)) {
+        worker();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace parallel
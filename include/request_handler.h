@@ -39,15 +39,25 @@ public:
 
     // загружает все доступные данные из JSON
     void LoadDataFromJson(const json_reader::JsonIO &json);
+    // загружает из JSON только настройки, необходимые для ответа на запросы по сохранённой базе
+    // (данные каталога и прочие настройки берутся из базы при десериализации)
+    void LoadRequestSettingsFromJson(const json_reader::JsonIO &json);
     void LoadDataFronJson(const std::filesystem::path &file_path);
 
     // загружает запросы из Json и выводит ответы в поток out
     void LoadRequestsAndAnswer(const json_reader::JsonIO &json, std::ostream &out);
+    // читает запросы по одному на строку (JSON Lines) из потока in и выводит ответы построчно в out,
+    // сбрасывая out каждые flush_batch ответов; настройки вывода берутся из json
+    // по окончании потока выводит статистику времени обработки запросов в stats_out
+    void LoadRequestStreamAndAnswer(const json_reader::JsonIO &json, std::istream &in, std::ostream &out,
+                                    size_t flush_batch, std::ostream &stats_out = std::cerr);
 
     // Сериализует доступные данные
     bool SerializeData();
     // Десериализует доступные данные
     bool DeserializeData();
+    // Сохраняет в файл дельты изменения загруженных данных относительно базы (с уже выпущенными дельтами)
+    bool SerializeDelta();
 
     // Принудительно переинициализирует маршрутизатор
     // (необходимо в случае внесения изменений в каталог или настройки маршрутизации)
@@ -61,6 +71,8 @@ public:
 private:
     // инициализирует маршрутизатор (если ещё не инициалирован)
     bool InitRouter();
+    // подключает к маршрутизатору контрольные точки построения из настроек сериализации
+    void SetRouterCheckpoints();
 
     TransportCatalogue &catalogue_;
     std::unique_ptr<transport_router::TransportRouter> router_;
@@ -69,6 +81,9 @@ private:
     std::optional<RoutingSettings> routing_settings_;
     std::optional<serialize::Serializator::Settings> serialize_settings_;
 
+    // кэш отрисованной карты для повторных запросов Map
+    renderer::MapRenderCache map_cache_;
+
 };
 
 } // namespace transport_catalogue
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <unordered_map>
@@ -22,6 +23,18 @@ private:
 public:
     explicit Router(const Graph& graph, bool initialize = true);
 
+    // Таблица последних рёбер кратчайших маршрутов во внешней памяти (например, в отображённом в память
+    // файле базы): prev_edges[from * vertex_count + to] - последнее ребро маршрута from -> to,
+    // увеличенное на 1; 0 - маршрута нет (или from == to)
+    struct PrevEdgeTable {
+        const uint32_t* prev_edges = nullptr;
+        // владелец памяти таблицы
+        std::shared_ptr<const void> owner;
+    };
+    // создаёт маршрутизатор, который отвечает на запросы по готовой таблице без её копирования;
+    // вес маршрута в этом режиме - сумма весов его рёбер
+    Router(const Graph& graph, PrevEdgeTable table);
+
     struct RouteInfo {
         Weight weight;
         std::vector<EdgeId> edges;
@@ -29,6 +42,12 @@ public:
 
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
+    // Пошаговое вычисление таблицы маршрутизатора, созданного без инициализации (например, чтобы сохранять
+    // промежуточное состояние): InitializeRoutes заполняет таблицу рёбрами графа, RelaxRoutes выполняет шаги
+    // алгоритма для промежуточных вершин [first_vertex, last_vertex) - вершины проходятся по возрастанию
+    void InitializeRoutes();
+    void RelaxRoutes(VertexId first_vertex, VertexId last_vertex);
+
     struct RouteInternalData {
         Weight weight;
         std::optional<EdgeId> prev_edge;
@@ -76,9 +95,12 @@ private:
         }
     }
 
+    std::optional<RouteInfo> BuildRouteFromTable(VertexId from, VertexId to) const;
+
     static constexpr Weight ZERO_WEIGHT{};
     const Graph& graph_;
     RoutesInternalData routes_internal_data_;
+    PrevEdgeTable table_;
 public:
     // доступ к внутренним данным
     RoutesInternalData& GetRoutesInternalData() {
@@ -105,9 +127,32 @@ Router<Weight>::Router(const Graph& graph, bool initialize)
     }
 }
 
+template <typename Weight>
+void Router<Weight>::InitializeRoutes() {
+    InitializeRoutesInternalData(graph_);
+}
+
+template <typename Weight>
+void Router<Weight>::RelaxRoutes(VertexId first_vertex, VertexId last_vertex) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    for (VertexId vertex_through = first_vertex; vertex_through < last_vertex; ++vertex_through) {
+        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    }
+}
+
+template <typename Weight>
+Router<Weight>::Router(const Graph& graph, PrevEdgeTable table)
+    : graph_(graph)
+    , table_(std::move(table))
+{
+}
+
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
                                                                              VertexId to) const {
+    if (table_.prev_edges) {
+        return BuildRouteFromTable(from, to);
+    }
     const auto& route_internal_data = routes_internal_data_.at(from).at(to);
     if (!route_internal_data) {
         return std::nullopt;
@@ -125,4 +170,30 @@ std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(Ver
     return RouteInfo{weight, std::move(edges)};
 }
 
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRouteFromTable(VertexId from,
+                                                                                      VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    const uint32_t* row = table_.prev_edges + from * vertex_count;
+    Weight weight = ZERO_WEIGHT;
+    std::vector<EdgeId> edges;
+    for (uint32_t prev_edge = row[to]; prev_edge != 0; prev_edge = row[graph_.GetEdge(edges.back()).from]) {
+        // в кратчайшем маршруте не больше vertex_count - 1 рёбер, иначе таблица повреждена
+        if (edges.size() >= vertex_count || prev_edge > graph_.GetEdgeCount()) {
+            throw std::runtime_error("Routes table is corrupted");
+        }
+        edges.push_back(prev_edge - 1);
+        weight = weight + graph_.GetEdge(edges.back()).weight;
+    }
+    if (edges.empty() && from != to) {
+        return std::nullopt;
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{weight, std::move(edges)};
+}
+
 }  // namespace graph
@@ -1,10 +1,18 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
 
 #include "map_renderer.h"
+#include "mapped_file.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
 #include "transport_catalogue.pb.h"
@@ -21,27 +29,132 @@ public:
 
     struct Settings {
         std::filesystem::path path;
+        // сохранять в базе заранее отрисованную карту (для ответа на запросы Map без отрисовки)
+        bool prerender_map = false;
+
+        // формат файла базы: protobuf, плоский формат, который читается из отображённого в память
+        // файла (см. flat_base.h), либо потоковый - последовательность сообщений protobuf с префиксом длины,
+        // которые записываются и загружаются по одному; при загрузке формат определяется по содержимому файла
+        enum class Format { PROTOBUF, FLAT, STREAM };
+        Format format = Format::PROTOBUF;
+
+        // какие данные маршрутизатора сохраняются в базе:
+        // FULL - граф и таблица кратчайших маршрутов (размер таблицы растёт как квадрат числа остановок),
+        // GRAPH - только граф, таблица строится по нему при первом запросе маршрута,
+        // NONE - только настройки маршрутизации, граф и таблица строятся по каталогу при первом запросе маршрута
+        enum class RouterPolicy { FULL, GRAPH, NONE };
+        RouterPolicy router_policy = RouterPolicy::FULL;
+
+        // хранить координаты остановок в миллионных долях градуса (около 0.1 м) вместо чисел double
+        bool quantize_coordinates = false;
+
+        // файлы дельт (изменений базы), которые применяются к базе по порядку при загрузке
+        std::vector<std::filesystem::path> deltas;
+        // файл, в который make_delta записывает изменения относительно базы с уже применёнными дельтами
+        std::filesystem::path delta_file;
+
+        // файл контрольных точек построения таблицы маршрутизатора в make_base (пусто - без контрольных точек):
+        // при повторном запуске построение продолжается с последней контрольной точки
+        std::filesystem::path checkpoint_file;
+        // минимальный интервал между контрольными точками в секундах
+        double checkpoint_interval = 300;
+        // доля времени построения, которую могут занимать контрольные точки
+        double checkpoint_max_overhead = 0.05;
     };
 
-    Serializator(const Settings &settings) : settings_(settings) {};
+    Serializator(const Settings &settings)
+        : settings_(settings)
+        , proto_catalogue_(google::protobuf::Arena::CreateMessage<ProtoTransportCatalogue>(&arena_)) {};
     void ResetSettings(const Settings &settings);
 
     // Добавляет данные транспортного каталога для сериализации
     void AddTransportCatalogue(const TransportCatalogue &catalogue);
     // Добавляет настройки рендеринга для сериализации
     void AddRenderSettings(const renderer::RenderSettings &settings);
-    // Добавляет данные маршрутизатора для сериализации
+    // Добавляет данные маршрутизатора для сериализации в соответствии с settings.router_policy
     void AddTransportRouter(const TransportRouter &router);
+    // Добавляет отрисованную карту (SVG-текст) для сериализации
+    void AddRenderedMap(const std::string &map);
+    // Добавляет настройки маршрутизации без данных маршрутизатора (для дельты)
+    void AddRoutingSettings(const TransportRouter::RoutingSettings &settings);
+    // Добавляет для сериализации в дельту изменения каталога catalogue относительно каталога base
+    // (изменённые настройки добавляются в дельту методами AddRenderSettings и AddRoutingSettings)
+    void AddCatalogueDelta(const TransportCatalogue &base, const TransportCatalogue &catalogue);
 
     // сохраняет данные транспортного каталога в бинарном виде в соответсвии с настройками
     bool Serialize();
+    // сохраняет подготовленные изменения в файл дельты settings.delta_file
+    bool SerializeDelta();
+
+    // возвращает отрисованную карту, сохранённую в базе
+    using MapLoader = std::function<std::string()>;
+
+    // сохраняет в файл path контрольную точку: таблицу router графа graph, вычисленную
+    // для промежуточных вершин [0, next_vertex); файл заменяется только после успешной записи
+    static bool SaveRouterCheckpoint(const std::filesystem::path &path, const TransportRouter::Graph &graph,
+                                     const TransportRouter::Router &router, size_t next_vertex);
+    // загружает в router таблицу из контрольной точки, если она сделана для того же графа;
+    // возвращает промежуточную вершину, с которой продолжается построение (0 - контрольной точки нет)
+    static size_t LoadRouterCheckpoint(const std::filesystem::path &path, const TransportRouter::Graph &graph,
+                                       TransportRouter::Router &router);
 
     // загружает данные в транспортный каталог из файла в соответствии с настройками
+    // если в базе сохранена отрисованная карта - в rendered_map возвращается функция, которая её загружает
+    // (в плоском формате карта читается из файла только при вызове, как и маршрутизатор -
+    // при первом построении маршрута).
+    // После базы применяются дельты settings.deltas: если дельта меняет данные, по которым построен
+    // маршрутизатор, он строится заново по каталогу при первом запросе маршрута; если меняется карта -
+    // сохранённая карта не используется
     bool Deserialize(TransportCatalogue &catalogue,
                      std::optional<renderer::RenderSettings> &settings,
-                     std::unique_ptr<TransportRouter> &router_);
+                     std::unique_ptr<TransportRouter> &router_,
+                     MapLoader &rendered_map);
 private:
-    void Clear() noexcept;
+    void Clear();
+
+    // загружает базу без дельт
+    bool DeserializeBase(TransportCatalogue &catalogue,
+                         std::optional<renderer::RenderSettings> &settings,
+                         std::unique_ptr<TransportRouter> &router,
+                         MapLoader &rendered_map);
+    // применяет к загруженным данным дельту из файла path
+    bool ApplyDelta(const std::filesystem::path &path,
+                    TransportCatalogue &catalogue,
+                    std::optional<renderer::RenderSettings> &settings,
+                    std::unique_ptr<TransportRouter> &router,
+                    MapLoader &rendered_map);
+
+    // загружает в каталог и маршрутизатор данные текущей части (для формата protobuf - всей базы)
+    void LoadChunk(TransportCatalogue &catalogue,
+                   std::optional<renderer::RenderSettings> &settings,
+                   std::unique_ptr<TransportRouter> &router,
+                   MapLoader &rendered_map);
+    // проверяет сигнатуру потокового формата и пропускает её
+    static bool IsStream(google::protobuf::io::ZeroCopyInputStream &input);
+    // проверяет сигнатуру файла дельты и пропускает её
+    static bool IsDelta(google::protobuf::io::ZeroCopyInputStream &input);
+    // потоковый формат: учитывает count добавленных в текущую часть элементов и записывает часть,
+    // когда она заполнена (в остальных форматах ничего не делает).
+    // После вызова указатели на вложенные сообщения proto_catalogue_ могут стать недействительными
+    void AddChunkItems(size_t count);
+    // записывает текущую часть в файл, открывая его при первой записи
+    void FlushChunk();
+    // освобождает сообщения текущей части
+    void ResetChunk();
+
+    // записывает подготовленные данные в плоском формате
+    bool SerializeFlat(std::ostream &out) const;
+    // загружает данные из файла базы в плоском формате; таблица маршрутизатора не копируется,
+    // а читается из отображённого файла, который остаётся открытым, пока существует маршрутизатор
+    bool DeserializeFlat(const std::shared_ptr<const mapped_file::MappedFile> &file,
+                         TransportCatalogue &catalogue,
+                         std::optional<renderer::RenderSettings> &settings,
+                         std::unique_ptr<TransportRouter> &router,
+                         MapLoader &rendered_map);
+    // строит граф и маршрутизатор по разделам базы в плоском формате
+    static void LoadFlatRouter(const std::shared_ptr<const mapped_file::MappedFile> &file,
+                               const TransportCatalogue &catalogue,
+                               TransportRouter &router);
 
     void SaveStops(const TransportCatalogue &catalogue);
     void LoadStops(TransportCatalogue &catalogue);
@@ -59,6 +172,11 @@ private:
     void LoadRenderSettings(std::optional<renderer::RenderSettings> &settings) const;
 
     void SaveTransportRouter(const TransportRouter &router);
+    // создаёт маршрутизатор (если его ещё нет), загружает списки рёбер вершин графа и готовит таблицу;
+    // возвращает число частей, на которые делится загрузка таблицы из текущей части базы (0 - таблицы нет)
+    size_t PrepareTransportRouter(const TransportCatalogue &catalogue,
+                                  std::unique_ptr<TransportRouter> &transport_router);
+    // загружает остановки маршрутизатора и рёбра графа (после загрузки каталога)
     void LoadTransportRouter(const TransportCatalogue &catalogue,
                              std::unique_ptr<TransportRouter> &transport_router);
 
@@ -66,13 +184,20 @@ private:
     void LoadTransportRouterSettings(TransportRouter::RoutingSettings &routing_settings) const;
 
     void SaveGraph(const TransportRouter::Graph &graph);
-    void LoadGraph(const TransportCatalogue &catalogue, TransportRouter::Graph &graph);
+    void LoadGraphEdges(const TransportCatalogue &catalogue, TransportRouter::Graph &graph) const;
+    void LoadIncidenceLists(TransportRouter::Graph &graph) const;
 
     void SaveRouter(const std::unique_ptr<TransportRouter::Router> &router);
-    void LoadRouter(const TransportCatalogue &catalogue, std::unique_ptr<TransportRouter::Router> &router);
+    // загружает часть part из part_count частей строк таблицы маршрутизатора
+    // (части независимы и могут загружаться параллельно)
+    void LoadRouter(TransportRouter::Router &router, size_t part, size_t part_count) const;
+    // загружает таблицу маршрутизатора, записанную в прежней схеме (сообщение на каждую ячейку)
+    void LoadLegacyRouter(TransportRouter::Router &router) const;
 
     static transport_catalogue_serialize::Coordinates MakeProtoCoordinates(const geo::Coordinates &coordinates);
     static geo::Coordinates MakeCoordinates(const transport_catalogue_serialize::Coordinates &p_coordinates);
+    // координаты остановки в любом из представлений (double или миллионные доли градуса)
+    static geo::Coordinates MakeStopCoordinates(const transport_catalogue_serialize::Stop &p_stop);
 
     static transport_catalogue_serialize::RouteType MakeProtoRouteType(domain::RouteType route_type);
     static domain::RouteType MakeRouteType(transport_catalogue_serialize::RouteType p_route_type);
@@ -89,7 +214,15 @@ private:
 
     Settings settings_;
 
-    ProtoTransportCatalogue proto_catalogue_;
+    // сообщение базы и все вложенные сообщения размещаются в арене: при формировании и разборе большой базы
+    // память выделяется крупными блоками, а не отдельно под каждое сообщение
+    google::protobuf::Arena arena_;
+    ProtoTransportCatalogue *proto_catalogue_;
+
+    // выходной поток и число элементов в текущей части потокового формата
+    std::unique_ptr<google::protobuf::io::FileOutputStream> stream_;
+    bool stream_failed_ = false;
+    size_t chunk_items_ = 0;
     std::unordered_map<int, std::string_view> stop_name_by_id_;
     std::unordered_map<std::string_view, int> stop_id_by_name_;
     std::unordered_map<int, std::string_view> route_name_by_id_;
@@ -5,9 +5,13 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
+#include "number_format.h"
+
 namespace svg {
 
 struct Point {
@@ -19,31 +23,80 @@ struct Point {
     double x = 0;
     double y = 0;
 };
+inline bool operator==(const Point &lhs, const Point &rhs) {
+    return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+inline bool operator!=(const Point &lhs, const Point &rhs) {
+    return !(lhs == rhs);
+}
+
+/*
+ * Буфер вывода SVG-документа: дописывает данные в конец строки
+ * без накладных расходов std::ostream (sentry, локаль, виртуальные вызовы streambuf)
+ */
+class Writer {
+public:
+    explicit Writer(std::string &buffer)
+        : buffer_(buffer) {
+    }
+    Writer& operator<<(std::string_view text) {
+        buffer_.append(text);
+        return *this;
+    }
+    Writer& operator<<(char c) {
+        buffer_.push_back(c);
+        return *this;
+    }
+    Writer& operator<<(int value) {
+        number_format::Append(buffer_, value);
+        return *this;
+    }
+    Writer& operator<<(number_format::Formatted number) {
+        number_format::Append(buffer_, number.value, number.settings);
+        return *this;
+    }
+    // дописывает текст, экранируя служебные символы XML
+    void WriteEscaped(std::string_view text);
+    // дописывает count пробелов
+    void WriteIndent(int count) {
+        buffer_.append(static_cast<size_t>(count), ' ');
+    }
+    std::string& GetBuffer() {
+        return buffer_;
+    }
+private:
+    std::string &buffer_;
+};
 
 /*
  * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
- * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
+ * Хранит ссылку на буфер вывода, текущее значение и шаг отступа при выводе элемента,
+ * а также формат вывода чисел
  */
 struct RenderContext {
-    RenderContext(std::ostream &out)
+    RenderContext(Writer &out)
         : out(out) {
     }
-    RenderContext(std::ostream &out, int indent_step, int indent = 0)
+    RenderContext(Writer &out, int indent_step, int indent = 0, number_format::Settings number_format = {})
         : out(out)
         , indent_step(indent_step)
-        , indent(indent) {
+        , indent(indent)
+        , number_format(number_format) {
     }
     RenderContext Indented() const {
-        return {out, indent_step, indent + indent_step};
+        return {out, indent_step, indent + indent_step, number_format};
     }
     void RenderIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
-        }
+        out.WriteIndent(indent);
     }
-    std::ostream &out;
+    // возвращает число, оформленное для вывода в соответствии с настройками
+    number_format::Formatted Format(double value) const {
+        return {value, number_format};
+    }
+    Writer &out;
     int indent_step = 0;
     int indent = 0;
+    number_format::Settings number_format;
 };
 
 // Цветовые типы
@@ -55,6 +108,12 @@ struct Rgb {
     uint8_t green = 0;
     uint8_t blue = 0;
 };
+inline bool operator==(const Rgb &lhs, const Rgb &rhs) {
+    return lhs.red == rhs.red && lhs.green == rhs.green && lhs.blue == rhs.blue;
+}
+inline bool operator!=(const Rgb &lhs, const Rgb &rhs) {
+    return !(lhs == rhs);
+}
 
 struct Rgba {
     Rgba() = default;
@@ -64,17 +123,26 @@ struct Rgba {
     uint8_t blue = 0;
     double opacity = 1.0;
 };
+inline bool operator==(const Rgba &lhs, const Rgba &rhs) {
+    return lhs.red == rhs.red && lhs.green == rhs.green && lhs.blue == rhs.blue && lhs.opacity == rhs.opacity;
+}
+inline bool operator!=(const Rgba &lhs, const Rgba &rhs) {
+    return !(lhs == rhs);
+}
 
 using Color = std::variant<std::monostate, std::string, Rgb, Rgba>;
 inline const Color NoneColor{};
 struct OstreamColorPrinter {
     std::ostream& out;
+    number_format::Settings number_format{};
     void operator()(std::monostate) const;
-    void operator()(std::string) const;
+    void operator()(const std::string &color) const;
     void operator()(Rgb) const;
     void operator()(Rgba) const;
 };
-std::ostream& operator<<(std::ostream &out, Color color);
+std::ostream& operator<<(std::ostream &out, const Color &color);
+// выводит цвет в буфер документа с заданным форматом чисел (для прозрачности rgba)
+void PrintColor(const RenderContext &context, const Color &color);
 
 // Вспомогательные типы для PathProps
 
@@ -83,11 +151,14 @@ enum class StrokeLineCap {
     ROUND,
     SQUARE,
 };
-std::string TagStrokeLineCap(StrokeLineCap line_cap);
+std::string_view TagStrokeLineCap(StrokeLineCap line_cap);
 inline std::ostream& operator<<(std::ostream &out, StrokeLineCap line_cap) {
     out << TagStrokeLineCap(line_cap);
     return out;
 }
+inline Writer& operator<<(Writer &out, StrokeLineCap line_cap) {
+    return out << TagStrokeLineCap(line_cap);
+}
 
 enum class StrokeLineJoin {
     ARCS,
@@ -96,16 +167,22 @@ enum class StrokeLineJoin {
     MITER_CLIP,
     ROUND,
 };
-std::string TagStrokeLineJoin(StrokeLineJoin line_join);
+std::string_view TagStrokeLineJoin(StrokeLineJoin line_join);
 inline std::ostream& operator<<(std::ostream &out, StrokeLineJoin line_join) {
     out << TagStrokeLineJoin(line_join);
     return out;
 }
+inline Writer& operator<<(Writer &out, StrokeLineJoin line_join) {
+    return out << TagStrokeLineJoin(line_join);
+}
 
-// Класс PathProps реализует заливку и контур объектов.
+// Класс PathProps реализует заливку и контур объектов,
+// а также идентификатор и CSS-класс, через которые оформление может задаваться таблицей стилей
 template <typename Owner>
 class PathProps {
 public:
+    Owner& SetId(std::string id);
+    Owner& SetClass(std::string class_name);
     Owner& SetFillColor(Color color);
     Owner& SetStrokeColor(Color color);
     Owner& SetStrokeWidth(double width);
@@ -113,12 +190,14 @@ public:
     Owner& SetStrokeLineJoin(StrokeLineJoin line_join);
 protected:
     ~PathProps() = default;
-    void RenderAttrs(std::ostream& out) const;
+    void RenderAttrs(const RenderContext &context) const;
 private:
     Owner& AsOwner() {
         return static_cast<Owner&>(*this);
     }
 
+    std::optional<std::string> id_;
+    std::optional<std::string> class_;
     std::optional<Color> fill_color_;
     std::optional<Color> stroke_color_;
     std::optional<double> stroke_width_;
@@ -139,39 +218,9 @@ private:
     virtual void RenderObject(const RenderContext &context) const = 0;
 };
 
-// Класс ObjectContainer - реализует интерфейс для доступа к контейнеру SVG-объектов.
-class ObjectContainer {
-public:
-    // Метод Add добавляет в svg-документ любой объект-наследник svg::Object.
-    template <class Obj>
-    void Add(Obj obj) {
-        // вызываем метод AddPtr соответствующего наследника
-        AddPtr(std::make_unique<Obj>(std::move(obj)));
-    }
-    virtual void AddPtr(std::unique_ptr<Object> &&obj) = 0;
-    virtual ~ObjectContainer() = default;
-};
-
-// Класс Drawable - реализует интерфейс рисования на объекте ObjectContainer
-class Drawable {
-public:
-    virtual void Draw(ObjectContainer &container) const = 0;
-    virtual ~Drawable() = default;
-};
-
-// Класс Document - контейнер SVG-объектов с выводом в поток
-class Document final : public ObjectContainer {
-public:
-    // Добавляет в svg-документ объект-наследник svg::Object
-    void AddPtr(std::unique_ptr<Object> &&obj) override;
-    // Выводит в ostream svg-представление документа
-    void Render(std::ostream &out) const;
-private:
-    std::vector<std::unique_ptr<Object>> objects_;
-};
-
 // Класс Circle моделирует элемент <circle> для отображения круга
 class Circle final : public Object, public PathProps<Circle> {
+    friend class Document;
 public:
     Circle& SetCenter(Point center);
     Circle& SetRadius(double radius);
@@ -184,6 +233,7 @@ private:
 
 // Класс Polyline моделирует элемент <polyline> для отображения ломаных линий
 class Polyline final : public Object, public PathProps<Polyline> {
+    friend class Document;
 public:
     // Добавляет очередную вершину к ломаной линии
     Polyline& AddPoint(Point point);
@@ -195,6 +245,7 @@ private:
 
 // Класс Text моделирует элемент <text> для отображения текста
 class Text final : public Object, public PathProps<Text> {
+    friend class Document;
 public:
     // Задаёт координаты опорной точки (атрибуты x и y)
     Text& SetPosition(Point pos);
@@ -210,8 +261,6 @@ public:
     Text& SetData(const std::string &data);
 private:
     void RenderObject(const RenderContext &context) const override;
-    // возвращает строку с экранированными служебными символами
-    static std::string EscapeText(const std::string &text);
 
     Point pos_;
     Point offset_;
@@ -221,6 +270,148 @@ private:
     std::string data_;
 };
 
+// Класс Label моделирует элемент <text>, оформление которого целиком задаётся CSS-классом:
+// выводятся только атрибуты PathProps, координаты и текст
+class Label final : public Object, public PathProps<Label> {
+public:
+    Label& SetPosition(Point pos);
+    Label& SetData(std::string data);
+private:
+    void RenderObject(const RenderContext &context) const override;
+
+    Point pos_;
+    std::string data_;
+};
+
+// Класс Rect моделирует элемент <rect> для отображения прямоугольников
+class Rect final : public Object, public PathProps<Rect> {
+public:
+    // Задаёт координаты левого верхнего угла (атрибуты x и y)
+    Rect& SetPosition(Point pos);
+    // Задаёт ширину и высоту (атрибуты width и height)
+    Rect& SetSize(Point size);
+private:
+    void RenderObject(const RenderContext &context) const override;
+
+    Point pos_;
+    Point size_;
+};
+
+// Класс Use моделирует элемент <use> - копию элемента, определённого в <defs>, в заданной точке.
+// Ссылка выводится атрибутом xlink:href (SVG 1.1), поэтому документ с <use> объявляет пространство имён xlink
+class Use final : public Object, public PathProps<Use> {
+public:
+    // Задаёт идентификатор элемента, на который ссылается <use> (без символа #)
+    Use& SetHref(std::string id);
+    Use& SetPosition(Point pos);
+private:
+    void RenderObject(const RenderContext &context) const override;
+
+    std::string href_;
+    Point pos_;
+};
+
+// Класс Style моделирует элемент <style> с таблицей стилей CSS
+class Style final : public Object {
+public:
+    Style& SetContent(std::string content);
+private:
+    void RenderObject(const RenderContext &context) const override;
+
+    std::string content_;
+};
+
+// Класс ObjectContainer - реализует интерфейс для доступа к контейнеру SVG-объектов.
+class ObjectContainer {
+public:
+    // Метод Add добавляет в svg-документ любой объект-наследник svg::Object.
+    // Стандартные фигуры передаются контейнеру по значению, остальные объекты - через указатель
+    template <class Obj>
+    void Add(Obj obj) {
+        if constexpr (std::is_same_v<Obj, Circle> || std::is_same_v<Obj, Polyline> || std::is_same_v<Obj, Text>) {
+            AddShape(std::move(obj));
+        } else {
+            // вызываем метод AddPtr соответствующего наследника
+            AddPtr(std::make_unique<Obj>(std::move(obj)));
+        }
+    }
+    virtual void AddPtr(std::unique_ptr<Object> &&obj) = 0;
+    // по умолчанию стандартные фигуры хранятся так же, как и прочие объекты
+    virtual void AddShape(Circle &&circle) {
+        AddPtr(std::make_unique<Circle>(std::move(circle)));
+    }
+    virtual void AddShape(Polyline &&polyline) {
+        AddPtr(std::make_unique<Polyline>(std::move(polyline)));
+    }
+    virtual void AddShape(Text &&text) {
+        AddPtr(std::make_unique<Text>(std::move(text)));
+    }
+    virtual ~ObjectContainer() = default;
+};
+
+// Класс Drawable - реализует интерфейс рисования на объекте ObjectContainer
+class Drawable {
+public:
+    virtual void Draw(ObjectContainer &container) const = 0;
+    virtual ~Drawable() = default;
+};
+
+// Класс Document - контейнер SVG-объектов с выводом в буфер или поток.
+// Стандартные фигуры хранятся по значению в одном массиве и выводятся без виртуальных вызовов
+class Document final : public ObjectContainer {
+public:
+    // Добавляет в svg-документ объект-наследник svg::Object
+    void AddPtr(std::unique_ptr<Object> &&obj) override;
+    void AddShape(Circle &&circle) override;
+    void AddShape(Polyline &&polyline) override;
+    void AddShape(Text &&text) override;
+    // Выводит в ostream svg-представление документа
+    void Render(std::ostream &out, const number_format::Settings &number_format = {}) const;
+    // Дописывает svg-представление документа в конец строки
+    void Render(std::string &out, const number_format::Settings &number_format = {}) const;
+
+    // Части svg-представления для сборки документа из нескольких буферов:
+    // Render(out) = RenderBegin(out, HasLinks()) + RenderObjects(out) + RenderEnd(out)
+    // xlink - объявить пространство имён xlink (нужно, если в документе есть элементы <use>)
+    static void RenderBegin(std::string &out, bool xlink = false);
+    void RenderObjects(std::string &out, const number_format::Settings &number_format = {}) const;
+    static void RenderEnd(std::string &out);
+    // проверяет, есть ли в документе ссылки xlink:href
+    bool HasLinks() const {
+        return has_links_;
+    }
+private:
+    // выводит объект с отступом и переводом строки
+    template <typename Shape>
+    static void RenderShape(const Shape &shape, const RenderContext &context);
+    static void RenderShape(const std::unique_ptr<Object> &object, const RenderContext &context);
+
+    std::vector<std::variant<Circle, Polyline, Text, std::unique_ptr<Object>>> objects_;
+    bool has_links_ = false;
+};
+
+// Класс Defs моделирует элемент <defs> - контейнер определений, на которые ссылаются элементы <use>
+class Defs final : public Object, public ObjectContainer {
+public:
+    void AddPtr(std::unique_ptr<Object> &&obj) override;
+private:
+    void RenderObject(const RenderContext &context) const override;
+
+    std::vector<std::unique_ptr<Object>> objects_;
+};
+
+template<typename Owner>
+Owner& PathProps<Owner>::SetId(std::string id) {
+    id_ = std::move(id);
+    return AsOwner();
+}
+
+template<typename Owner>
+Owner& PathProps<Owner>::SetClass(std::string class_name) {
+    class_ = std::move(class_name);
+    return AsOwner();
+}
+
 template<typename Owner>
 Owner& PathProps<Owner>::SetFillColor(Color color) {
     fill_color_ = std::move(color);
@@ -252,19 +443,32 @@ Owner& PathProps<Owner>::SetStrokeLineJoin(StrokeLineJoin line_join) {
 }
 
 template<typename Owner>
-void PathProps<Owner>::RenderAttrs(std::ostream &out) const {
+void PathProps<Owner>::RenderAttrs(const RenderContext &context) const {
     using namespace std::literals;
+    auto &out = context.out;
+
+    if(id_) {
+        out << " id=\""sv << *id_ << "\""sv;
+    }
+
+    if(class_) {
+        out << " class=\""sv << *class_ << "\""sv;
+    }
 
     if(fill_color_) {
-        out << " fill=\""sv << *fill_color_ << "\""sv;
+        out << " fill=\""sv;
+        PrintColor(context, *fill_color_);
+        out << "\""sv;
     }
 
     if(stroke_color_) {
-        out << " stroke=\""sv << *stroke_color_ << "\""sv;
+        out << " stroke=\""sv;
+        PrintColor(context, *stroke_color_);
+        out << "\""sv;
     }
 
     if(stroke_width_) {
-        out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
+        out << " stroke-width=\""sv << context.Format(*stroke_width_) << "\""sv;
     }
 
     if(stroke_line_cap_) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <deque>
 #include <functional>
 #include <optional>
@@ -24,6 +25,8 @@ class TransportCatalogue final {
     std::unordered_map<std::string_view, const domain::Route*> routes_by_names_;
     // расстояния между остановками
     std::unordered_map<std::string_view, std::unordered_map<std::string_view, int>> distances_;
+    // версия данных - увеличивается при каждом изменении каталога
+    uint64_t version_ = 0;
 
 public:
     // добавляет остановку в каталог
@@ -35,6 +38,21 @@ public:
     // если какой-то из остановок нет в каталоге - выбрасывает исключение
     void SetDistance(const std::string &stop_from, const std::string &stop_to, int distance);
 
+    // изменяет координаты остановки
+    // если остановки нет в каталоге - выбрасывает исключение std::out_of_range
+    void SetStopCoordinates(const std::string &stop_name, geo::Coordinates coordinate);
+    // удаляет из каталога маршрут
+    // если маршрута нет в каталоге - выбрасывает исключение std::out_of_range
+    void RemoveRoute(const std::string &route_name);
+    // удаляет из каталога остановку вместе с расстояниями от неё и до неё
+    // если остановки нет в каталоге - выбрасывает исключение std::out_of_range,
+    // если через неё проходят маршруты - std::invalid_argument
+    void RemoveStop(const std::string &stop_name);
+    // удаляет из каталога расстояние от остановки 1 до остановки 2 (если оно задано)
+    void RemoveDistance(const std::string &stop_from, const std::string &stop_to);
+    // Удалённые остановки и маршруты остаются в хранилище: указатели и имена, полученные из каталога ранее,
+    // остаются действительными
+
     // возвращает информацию о маршруе по его имени
     // если маршрута нет в каталоге - выбрасывает исключение std::out_of_range
     domain::RouteInfo GetRouteInfo(const std::string &route_name) const;
@@ -54,6 +72,8 @@ public:
     const std::unordered_map<std::string_view, std::set<std::string_view>>& GetBusesOnStops() const;
     // возвращает ссылку на расстояния между остановками
     const std::unordered_map<std::string_view, std::unordered_map<std::string_view, int>>& GetDistances() const;
+    // возвращает версию данных каталога (для проверки актуальности построенных по нему кэшей)
+    uint64_t GetVersion() const noexcept;
 
 
 private:
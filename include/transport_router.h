@@ -4,6 +4,8 @@
 #include "router.h"
 #include "transport_catalogue.h"
 
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
@@ -59,6 +61,28 @@ public:
 
     // ленивая инициализация по данным каталога (запускается при первом запросе маршрута, либо вручную)
     void InitRouter();
+    // строит по данным каталога только граф, без таблицы маршрутизатора (например, для сохранения графа в базе);
+    // таблица строится по этому графу в InitRouter
+    void InitGraph();
+    // задаёт функцию, которая заполняет внутренние данные маршрутизатора (например, из файла базы)
+    // вместо построения по каталогу; вызывается один раз при ленивой инициализации
+    using Loader = std::function<void(TransportRouter&)>;
+    void SetLoader(Loader loader);
+    // Контрольные точки построения таблицы маршрутизатора в InitRouter (для продолжения после сбоя)
+    struct Checkpoints {
+        // загружает в таблицу сохранённое состояние и возвращает промежуточную вершину алгоритма,
+        // с которой продолжается построение (0 - состояния нет, таблица строится с начала)
+        std::function<size_t(const Graph&, Router&)> resume;
+        // сохраняет таблицу, вычисленную для промежуточных вершин [0, next_vertex)
+        std::function<void(const Graph&, const Router&, size_t next_vertex)> save;
+        // минимальный интервал между сохранениями
+        std::chrono::steady_clock::duration interval = std::chrono::minutes(5);
+        // доля времени построения, которую могут занимать сохранения: если сохранение длится дольше
+        // interval * max_overhead, следующее откладывается соответственно (0 - без ограничения)
+        double max_overhead = 0.05;
+    };
+    void SetCheckpoints(Checkpoints checkpoints);
+
     // инициализирует маршрутизатор внутренними данными, загруженными вручную
     // при неправильно инициализированных внутренних данных корректность работы не гарантируется
     void InternalInit();
@@ -79,6 +103,9 @@ public:
 private:
 
     bool is_initialized_ = false;
+    bool is_graph_initialized_ = false;
+    Loader loader_;
+    Checkpoints checkpoints_;
 
     const transport_catalogue::TransportCatalogue &catalogue_;
     RoutingSettings settings_;
@@ -90,6 +117,8 @@ private:
     mutable std::unique_ptr<Router> router_;
 
     void BuildEdges();
+    // строит таблицу маршрутизатора, сохраняя контрольные точки
+    void BuildRouterWithCheckpoints();
     size_t CountStops();
     graph::Edge<RouteWeight> MakeEdge(const domain::Route *route, int stop_from_index, int stop_to_index);
     double ComputeRouteTime(const domain::Route *route, int stop_from_index, int stop_to_index);
@@ -1,43 +1,97 @@
 #include <cassert>
+#include <charconv>
 #include <fstream>
 #include <iostream>
 #include <string_view>
 
+#include "parallel.h"
 #include "request_handler.h"
 
 using namespace std;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base [--parallel[=N]]|make_delta [--parallel[=N]]"sv
+           << "|process_requests [--jsonl[=N]]]\n"sv;
+}
+
+// разбирает флаг вида --name или --name=N
+// возвращает N (default_value, если значение не указано) либо 0, если флаг не совпал или задан с ошибкой
+size_t ParseFlag(std::string_view flag, std::string_view name, size_t default_value) {
+    if (flag.substr(0, name.size()) != name) {
+        return 0;
+    }
+    flag.remove_prefix(name.size());
+    if (flag.empty()) {
+        return default_value;
+    }
+    if (flag.front() != '=') {
+        return 0;
+    }
+    flag.remove_prefix(1);
+    size_t value = 0;
+    const auto [ptr, error] = std::from_chars(flag.data(), flag.data() + flag.size(), value);
+    if (error != std::errc{} || ptr != flag.data() + flag.size()) {
+        return 0;
+    }
+    return value;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    if (argc < 2 || argc > 3) {
         PrintUsage();
         return 1;
     }
 
     const std::string_view mode(argv[1]);
+    // число потоков для make_base --parallel
+    size_t thread_count = 0;
+    // размер пачки ответов между сбросами вывода для process_requests --jsonl
+    size_t flush_batch = 0;
+    if (argc == 3) {
+        if (mode == "make_base"sv || mode == "make_delta"sv) {
+            thread_count = ParseFlag(argv[2], "--parallel"sv, parallel::GetThreadCount());
+        } else if (mode == "process_requests"sv) {
+            flush_batch = ParseFlag(argv[2], "--jsonl"sv, 1);
+        }
+        if (thread_count == 0 && flush_batch == 0) {
+            PrintUsage();
+            return 1;
+        }
+    }
 
     transport_catalogue::TransportCatalogue catalogue;
     transport_catalogue::TransportCatalogueHandler catalogue_handler(catalogue);
 
-    if (mode == "make_base"sv) {
+    if (mode == "make_base"sv || mode == "make_delta"sv) {
+        // make_delta читает те же данные, что и make_base, но записывает только их отличия от базы
         ifstream in("make_base.json"s);
-        json_reader::JsonIO json(in);
+        // с флагом --parallel массив base_requests разбирается по частям на нескольких потоках
+        json_reader::JsonIO json = thread_count > 0
+                ? json_reader::JsonIO(in, json_reader::JsonIO::ParseMode::PARALLEL, thread_count)
+                : json_reader::JsonIO(in);
 
         catalogue_handler.LoadDataFromJson(json);
-        catalogue_handler.SerializeData();
+        if (mode == "make_delta"sv) {
+            catalogue_handler.SerializeDelta();
+        } else {
+            catalogue_handler.SerializeData();
+        }
 
     } else if (mode == "process_requests"sv) {
         ifstream in("process_requests.json"s);
-        json_reader::JsonIO json(in);
+        json_reader::JsonIO json(in, json_reader::JsonIO::ParseMode::REQUESTS);
 
-        catalogue_handler.LoadDataFromJson(json);
+        catalogue_handler.LoadRequestSettingsFromJson(json);
         catalogue_handler.DeserializeData();
 
-        ofstream out("result.json"s);
-        catalogue_handler.LoadRequestsAndAnswer(json, out);
+        if (flush_batch > 0) {
+            // запросы читаются построчно из stdin, ответы выводятся построчно в stdout
+            std::ios::sync_with_stdio(false);
+            catalogue_handler.LoadRequestStreamAndAnswer(json, cin, cout, flush_batch);
+        } else {
+            ofstream out("result.json"s);
+            catalogue_handler.LoadRequestsAndAnswer(json, out);
+        }
 
     } else {
         PrintUsage();
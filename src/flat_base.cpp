@@ -0,0 +1,84 @@
+#include "flat_base.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace serialize::flat {
+
+namespace {
+
+size_t Align(size_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+} // namespace
+
+void Writer::AddSection(SectionType type, std::string data) {
+    sections_.emplace_back(type, std::move(data));
+}
+
+bool Writer::Write(std::ostream &out) const {
+    Header header{};
+    std::memcpy(header.magic, MAGIC.data(), MAGIC.size());
+    header.version = VERSION;
+    header.section_count = static_cast<uint32_t>(sections_.size());
+
+    std::vector<SectionEntry> directory;
+    directory.reserve(sections_.size());
+    size_t offset = Align(sizeof(Header) + sizeof(SectionEntry) * sections_.size());
+    for (const auto &[type, data] : sections_) {
+        directory.push_back({static_cast<uint32_t>(type), 0, offset, data.size()});
+        offset = Align(offset + data.size());
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(directory.data()),
+              static_cast<std::streamsize>(directory.size() * sizeof(SectionEntry)));
+    size_t position = sizeof(Header) + sizeof(SectionEntry) * sections_.size();
+    static const char padding[ALIGNMENT]{};
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        out.write(padding, static_cast<std::streamsize>(directory[i].offset - position));
+        const auto &data = sections_[i].second;
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        position = directory[i].offset + data.size();
+    }
+    return static_cast<bool>(out);
+}
+
+bool Sections::IsFlat(std::string_view data) noexcept {
+    return data.substr(0, MAGIC.size()) == MAGIC;
+}
+
+std::optional<Sections> Sections::Parse(std::string_view data) {
+    if (!IsFlat(data) || data.size() < sizeof(Header)) {
+        return std::nullopt;
+    }
+    Header header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.version != VERSION
+            || header.section_count > (data.size() - sizeof(Header)) / sizeof(SectionEntry)) {
+        return std::nullopt;
+    }
+
+    Sections result;
+    const auto *directory = reinterpret_cast<const SectionEntry*>(data.data() + sizeof(Header));
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        const auto &entry = directory[i];
+        if (entry.offset % ALIGNMENT != 0 || entry.offset > data.size() || entry.size > data.size() - entry.offset) {
+            return std::nullopt;
+        }
+        result.sections_[entry.type] = data.substr(entry.offset, entry.size);
+    }
+    return result;
+}
+
+std::string_view Sections::GetBytes(SectionType type) const {
+    const auto it = sections_.find(static_cast<uint32_t>(type));
+    return it == sections_.end() ? std::string_view{} : it->second;
+}
+
+bool Sections::Has(SectionType type) const {
+    return sections_.count(static_cast<uint32_t>(type)) != 0;
+}
+
+} // namespace serialize::flat
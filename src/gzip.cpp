@@ -0,0 +1,100 @@
+#include "gzip.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std::literals;
+
+namespace gzip {
+
+namespace {
+
+// размер порции, на которую увеличивается выходной буфер
+constexpr size_t OUTPUT_CHUNK = 64 * 1024;
+// windowBits 15 + 16 - максимальное окно и заголовок gzip вместо zlib
+constexpr int GZIP_WINDOW_BITS = 15 + 16;
+constexpr int MEMORY_LEVEL = 8;
+
+} // namespace
+
+Writer::Writer(int level) {
+    level = std::clamp(level, 1, 9);
+    if (deflateInit2(&stream_, level, Z_DEFLATED, GZIP_WINDOW_BITS, MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw CompressionError("Failed to initialize gzip stream"s);
+    }
+}
+
+Writer::~Writer() {
+    deflateEnd(&stream_);
+}
+
+void Writer::Write(std::string_view data) {
+    if (finished_) {
+        throw CompressionError("Gzip stream is already finished"s);
+    }
+    // avail_in - 32-битный, поэтому большие части подаются порциями
+    while (!data.empty()) {
+        const auto size = static_cast<uInt>(std::min<size_t>(data.size(), std::numeric_limits<uInt>::max()));
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream_.avail_in = size;
+        Deflate(Z_NO_FLUSH);
+        data.remove_prefix(size);
+    }
+}
+
+std::string Writer::Finish() {
+    if (!finished_) {
+        stream_.next_in = nullptr;
+        stream_.avail_in = 0;
+        Deflate(Z_FINISH);
+        finished_ = true;
+    }
+    return std::move(result_);
+}
+
+void Writer::Deflate(int flush) {
+    while (true) {
+        const size_t used = result_.size();
+        result_.resize(used + OUTPUT_CHUNK);
+        stream_.next_out = reinterpret_cast<Bytef*>(result_.data() + used);
+        stream_.avail_out = static_cast<uInt>(OUTPUT_CHUNK);
+        const int code = deflate(&stream_, flush);
+        result_.resize(used + OUTPUT_CHUNK - stream_.avail_out);
+        if (code == Z_STREAM_ERROR) {
+            throw CompressionError("Gzip compression failed"s);
+        }
+        // выход заполнен не полностью - всё поданное сжато (для Z_FINISH - поток завершён)
+        if (flush == Z_FINISH ? code == Z_STREAM_END : stream_.avail_out != 0) {
+            return;
+        }
+    }
+}
+
+std::string EncodeBase64(std::string_view data) {
+    static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    result.reserve((data.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        const uint32_t triple = (static_cast<uint8_t>(data[i]) << 16)
+                | (static_cast<uint8_t>(data[i + 1]) << 8) | static_cast<uint8_t>(data[i + 2]);
+        result.push_back(ALPHABET[(triple >> 18) & 0x3F]);
+        result.push_back(ALPHABET[(triple >> 12) & 0x3F]);
+        result.push_back(ALPHABET[(triple >> 6) & 0x3F]);
+        result.push_back(ALPHABET[triple & 0x3F]);
+    }
+    // последние один или два байта дополняются символами '='
+    if (const size_t rest = data.size() - i; rest > 0) {
+        uint32_t triple = static_cast<uint8_t>(data[i]) << 16;
+        if (rest == 2) {
+            triple |= static_cast<uint8_t>(data[i + 1]) << 8;
+        }
+        result.push_back(ALPHABET[(triple >> 18) & 0x3F]);
+        result.push_back(ALPHABET[(triple >> 12) & 0x3F]);
+        result.push_back(rest == 2 ? ALPHABET[(triple >> 6) & 0x3F] : '=');
+        result.push_back('=');
+    }
+    return result;
+}
+
+} // namespace gzip
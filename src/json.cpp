@@ -285,6 +285,9 @@ bool Node::IsPureDouble() const noexcept {
     return std::holds_alternative<double>(*this);
 }
 bool Node::IsString() const noexcept {
+    if (const auto *shared = std::get_if<SharedString>(this)) {
+        return *shared != nullptr;
+    }
     return std::holds_alternative<std::string>(*this);
 }
 bool Node::IsArray() const noexcept {
@@ -339,7 +342,9 @@ double Node::AsDouble() const {
 }
 
 const string& Node::AsString() const {
-    if (IsString()) {
+    if (const auto *shared = std::get_if<SharedString>(this); shared && *shared) {
+        return **shared;
+    } else if (IsString()) {
         return std::get<std::string>(*this);
     } else {
         throw std::logic_error("Node data is not string"s);
@@ -369,22 +374,46 @@ namespace {
 
 // -------------------------- печать нод ----------------------------
 
-std::string AddEscapes(const std::string &str) {
-    std::string result;
-    for (auto c : str) {
-        if (c == '\"') {
-            result += "\\\"";
-        } else if (c == '\r') {
-            result += "\\r";
-        } else if (c == '\n') {
-            result += "\\n";
-        } else if (c == '\\') {
-            result += "\\\\";
-        } else {
-            result += c;
+// Выводит строку в кавычках, экранируя служебные символы.
+// Экранированный текст собирается в буфере фиксированного размера и сбрасывается в поток частями,
+// поэтому длинные строки (например, SVG-карта) выводятся без промежуточной копии
+void PrintEscaped(std::string_view str, std::ostream &out) {
+    char buffer[4096];
+    size_t size = 0;
+    buffer[size++] = '"';
+    for (const char c : str) {
+        // самая длинная замена - два символа
+        if (size + 2 > sizeof(buffer)) {
+            out.write(buffer, static_cast<std::streamsize>(size));
+            size = 0;
+        }
+        switch (c) {
+        case '"':
+            buffer[size++] = '\\';
+            buffer[size++] = '"';
+            break;
+        case '\r':
+            buffer[size++] = '\\';
+            buffer[size++] = 'r';
+            break;
+        case '\n':
+            buffer[size++] = '\\';
+            buffer[size++] = 'n';
+            break;
+        case '\\':
+            buffer[size++] = '\\';
+            buffer[size++] = '\\';
+            break;
+        default:
+            buffer[size++] = c;
         }
     }
-    return result;
+    if (size + 1 > sizeof(buffer)) {
+        out.write(buffer, static_cast<std::streamsize>(size));
+        size = 0;
+    }
+    buffer[size++] = '"';
+    out.write(buffer, static_cast<std::streamsize>(size));
 }
 
 void PrintNode(const Node &node, RenderContext ctx);
@@ -402,26 +431,27 @@ void PrintBoolNode(const Node& node, RenderContext ctx) {
 }
 
 void PrintIntNode(const Node& node, RenderContext ctx) {
-    ctx.out << node.AsInt();
+    number_format::Print(ctx.out, node.AsInt());
 }
 
 void PrintDoubleNode(const Node& node, RenderContext ctx) {
-    ctx.out << node.AsDouble();
+    number_format::Print(ctx.out, node.AsDouble(), ctx.number_format);
 }
 
 void PrintStringNode(const Node& node, RenderContext ctx) {
-    ctx.out << "\""sv << AddEscapes(node.AsString()) << "\""sv;
+    PrintEscaped(node.AsString(), ctx.out);
 }
 
 void PrintArrayNode(const Node& node, RenderContext ctx) {
-    auto arr = node.AsArray();
+    const auto &arr = node.AsArray();
     auto size = arr.size();
     if (size != 0) {
+        const auto separator = ctx.compact ? ","sv : ", "sv;
         ctx.out << "["sv;
         // вывожу первый элемент вне цикла, чтобы не было лишних пробелов в начале или в конце
         PrintNode(arr.at(0), ctx);
         for (auto i = 1u; i < size; ++i) {
-            ctx.out << ", "sv;
+            ctx.out << separator;
             PrintNode(arr.at(i), ctx);
         }
         ctx.out << "]"sv;
@@ -430,25 +460,44 @@ void PrintArrayNode(const Node& node, RenderContext ctx) {
     }
 }
 
+void PrintCompactMapNode(const Node& node, RenderContext ctx) {
+    ctx.out << "{"sv;
+    bool first = true;
+    for (const auto &[key, value] : node.AsMap()) {
+        if (!first) {
+            ctx.out << ","sv;
+        }
+        first = false;
+        PrintEscaped(key, ctx.out);
+        ctx.out << ":"sv;
+        PrintNode(value, ctx);
+    }
+    ctx.out << "}"sv;
+}
+
 void PrintMapNode(const Node& node, RenderContext ctx) {
-    auto map = node.AsMap();
+    if (ctx.compact) {
+        PrintCompactMapNode(node, ctx);
+        return;
+    }
+    const auto &map = node.AsMap();
     auto size = map.size();
     if (size != 0) {
-        ctx.out << "{"sv << std::endl;
-        RenderContext map_ctx(ctx.out, ctx.indent + 2);
+        ctx.out << "{\n"sv;
+        RenderContext map_ctx(ctx.out, ctx.indent + 2, ctx.number_format);
         map_ctx.RenderIndent();
         // вывожу первую пару вне цикла, чтобы не было лишнего переноса строки в начале или в конце
         PrintNode(map.begin()->first, map_ctx);
         map_ctx.out << ": "sv;
         PrintNode(map.begin()->second, map_ctx);
         for (auto it = std::next(map.begin()); it != map.end(); ++it) {
-            map_ctx.out << ","sv << std::endl;
+            map_ctx.out << ",\n"sv;
             map_ctx.RenderIndent();
             PrintNode(it->first, map_ctx);
             map_ctx.out << ": "sv;
             PrintNode(it->second, map_ctx);
         }
-        ctx.out << std::endl;
+        ctx.out << "\n"sv;
         ctx.RenderIndent();
         ctx.out << "}"sv;
     } else {
@@ -476,9 +525,15 @@ void PrintNode(const Node &node, RenderContext ctx) {
 
 } // namespace
 
-void Print(const Document &doc, std::ostream& output) {
-    RenderContext ctx(output, 0);
+void Print(const Document &doc, std::ostream& output, const number_format::Settings &number_format) {
+    RenderContext ctx(output, 0, number_format);
     PrintNode(doc.GetRoot(), ctx);
 }
 
+void PrintCompact(const Node &node, std::ostream &output, const number_format::Settings &number_format) {
+    RenderContext ctx(output, 0, number_format);
+    ctx.compact = true;
+    PrintNode(node, ctx);
+}
+
 }  // namespace json
@@ -26,27 +26,28 @@ Builder::KeyItemContext Builder::Key(std::string key) {
 
 Builder &Builder::Value(NodeData value) {
 
-    Node new_node = std::visit([](auto val){
-        return Node(val);
-    }, value);
+    // значение перемещается в дерево без копирования (важно для длинных строк)
+    Node new_node = std::visit([](auto &&val){
+        return Node(std::move(val));
+    }, std::move(value));
 
     // Если класс еще пустой
     if (is_empty_) {
-        root_ = new_node;
+        root_ = std::move(new_node);
         is_empty_ = false;
         return *this;
     }
 
     // Если мы внутри словаря и ключ уже добавлен
     if (!nodes_stack_.empty() && nodes_stack_.back()->IsMap() && has_key_) {
-        const_cast<Dict&>(nodes_stack_.back()->AsMap()).insert({key_, new_node});
+        const_cast<Dict&>(nodes_stack_.back()->AsMap()).insert({key_, std::move(new_node)});
         has_key_ = false;
         return *this;
     }
 
     // Если мы внутри массива
     if (!nodes_stack_.empty() && nodes_stack_.back()->IsArray()) {
-        const_cast<Array&>(nodes_stack_.back()->AsArray()).push_back(new_node);
+        const_cast<Array&>(nodes_stack_.back()->AsArray()).push_back(std::move(new_node));
         return *this;
     }
 
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -9,20 +12,55 @@ using namespace std::literals;
 
 namespace json_reader {
 
-JsonIO::JsonIO(std::istream &data_in)
-    : data_(json::Load(data_in)) {
+JsonIO::JsonIO(std::istream &data_in, ParseMode mode, size_t thread_count) {
+    if (mode == ParseMode::LAZY) {
+        lazy_data_ = json::LoadLazy(data_in);
+    } else if (mode == ParseMode::REQUESTS) {
+        // остальные разделы (base_requests и т.д.) пропускаются ещё при построении ленты
+        lazy_data_ = json::LoadLazy(data_in, {"serialization_settings"s, "output_settings"s, "stat_requests"s});
+    } else if (mode == ParseMode::PARALLEL) {
+        // base_requests остаётся в ленте необработанным текстом и разбирается при первом обращении
+        lazy_data_ = json::LoadLazy(data_in, {"serialization_settings"s, "routing_settings"s, "render_settings"s});
+        thread_count_ = std::max<size_t>(thread_count, 1);
+    } else {
+        data_ = json::Load(data_in);
+    }
+}
+
+const json::Node* JsonIO::GetSection(const std::string &name) const {
+    if (!lazy_data_) {
+        if (data_.GetRoot().IsMap() && data_.GetRoot().AsMap().count(name) > 0) {
+            return &data_.GetRoot().AsMap().at(name);
+        }
+        return nullptr;
+    }
+    // в ленивом режиме строим json::Node только для запрошенного раздела
+    if (auto found = sections_.find(name); found != sections_.end()) {
+        return &found->second;
+    }
+    const auto root = lazy_data_->GetRoot();
+    if (!root.IsMap()) {
+        return nullptr;
+    }
+    const auto section = root.Find(name);
+    if (!section) {
+        return nullptr;
+    }
+    if (section->IsRaw() && thread_count_ > 1) {
+        return &sections_.emplace(name, json::LoadArrayParallel(section->AsRawText(), thread_count_)).first->second;
+    }
+    return &sections_.emplace(name, section->Materialize()).first->second;
 }
 
 bool JsonIO::LoadData(transport_catalogue::TransportCatalogue &catalogue) const {
 
     // Загружаем данные в каталог, если они есть
-    if (data_.GetRoot().IsMap() && data_.GetRoot().AsMap().count("base_requests"s) > 0) {
-        auto &base_requests = data_.GetRoot().AsMap().at("base_requests"s);
+    if (auto base_requests = GetSection("base_requests"s)) {
         // проверяем, что данные для загрузки хранятся в нужном формате
-        if (base_requests.IsArray()) {
-            LoadStops(base_requests.AsArray(), catalogue);
-            LoadRoutes(base_requests.AsArray(), catalogue);
-            LoadDistances(base_requests.AsArray(), catalogue);
+        if (base_requests->IsArray()) {
+            LoadStops(base_requests->AsArray(), catalogue);
+            LoadRoutes(base_requests->AsArray(), catalogue);
+            LoadDistances(base_requests->AsArray(), catalogue);
             return true;
         }
     }
@@ -31,10 +69,9 @@ bool JsonIO::LoadData(transport_catalogue::TransportCatalogue &catalogue) const
 
 std::optional<renderer::RenderSettings> JsonIO::LoadRenderSettings() const {
     // загружаем параметры рендеринга, если они есть
-    if (data_.GetRoot().IsMap() && data_.GetRoot().AsMap().count("render_settings"s) > 0) {
-        auto &render_settings = data_.GetRoot().AsMap().at("render_settings"s);
-        if (render_settings.IsMap()) {
-            return LoadSettings(render_settings.AsMap());
+    if (auto render_settings = GetSection("render_settings"s)) {
+        if (render_settings->IsMap()) {
+            return LoadSettings(render_settings->AsMap());
         }
     }
     return std::nullopt;
@@ -42,11 +79,56 @@ std::optional<renderer::RenderSettings> JsonIO::LoadRenderSettings() const {
 
 std::optional<serialize::Serializator::Settings> JsonIO::LoadSerializeSettings() const {
     // загружаем параметры сериализации, если они есть
-    if (data_.GetRoot().IsMap() && data_.GetRoot().AsMap().count("serialization_settings"s) > 0) {
-        auto &serialization_settngs = data_.GetRoot().AsMap().at("serialization_settings"s);
-        if (serialization_settngs.IsMap() && serialization_settngs.AsMap().count("file"s) > 0) {
+    if (auto serialization_settngs = GetSection("serialization_settings"s)) {
+        if (serialization_settngs->IsMap() && serialization_settngs->AsMap().count("file"s) > 0) {
+            const auto &data = serialization_settngs->AsMap();
             serialize::Serializator::Settings result;
-            result.path = serialization_settngs.AsMap().at("file"s).AsString();
+            result.path = data.at("file"s).AsString();
+            if (data.count("prerender_map"s) > 0 && data.at("prerender_map"s).IsBool()) {
+                result.prerender_map = data.at("prerender_map"s).AsBool();
+            }
+            if (data.count("format"s) > 0 && data.at("format"s).IsString()) {
+                const auto &format = data.at("format"s).AsString();
+                if (format == "flat"sv) {
+                    result.format = serialize::Serializator::Settings::Format::FLAT;
+                } else if (format == "stream"sv) {
+                    result.format = serialize::Serializator::Settings::Format::STREAM;
+                } else if (format == "protobuf"sv) {
+                    result.format = serialize::Serializator::Settings::Format::PROTOBUF;
+                }
+            }
+            if (data.count("router_policy"s) > 0 && data.at("router_policy"s).IsString()) {
+                const auto &policy = data.at("router_policy"s).AsString();
+                if (policy == "full"sv) {
+                    result.router_policy = serialize::Serializator::Settings::RouterPolicy::FULL;
+                } else if (policy == "graph"sv) {
+                    result.router_policy = serialize::Serializator::Settings::RouterPolicy::GRAPH;
+                } else if (policy == "none"sv) {
+                    result.router_policy = serialize::Serializator::Settings::RouterPolicy::NONE;
+                }
+            }
+            if (data.count("quantize_coordinates"s) > 0 && data.at("quantize_coordinates"s).IsBool()) {
+                result.quantize_coordinates = data.at("quantize_coordinates"s).AsBool();
+            }
+            if (data.count("deltas"s) > 0 && data.at("deltas"s).IsArray()) {
+                for (const auto &delta : data.at("deltas"s).AsArray()) {
+                    if (delta.IsString()) {
+                        result.deltas.emplace_back(delta.AsString());
+                    }
+                }
+            }
+            if (data.count("delta_file"s) > 0 && data.at("delta_file"s).IsString()) {
+                result.delta_file = data.at("delta_file"s).AsString();
+            }
+            if (data.count("checkpoint_file"s) > 0 && data.at("checkpoint_file"s).IsString()) {
+                result.checkpoint_file = data.at("checkpoint_file"s).AsString();
+            }
+            if (data.count("checkpoint_interval"s) > 0 && data.at("checkpoint_interval"s).IsDouble()) {
+                result.checkpoint_interval = std::max(0.0, data.at("checkpoint_interval"s).AsDouble());
+            }
+            if (data.count("checkpoint_max_overhead"s) > 0 && data.at("checkpoint_max_overhead"s).IsDouble()) {
+                result.checkpoint_max_overhead = std::max(0.0, data.at("checkpoint_max_overhead"s).AsDouble());
+            }
             return result;
         }
     }
@@ -55,10 +137,9 @@ std::optional<serialize::Serializator::Settings> JsonIO::LoadSerializeSettings()
 
 std::optional<transport_router::TransportRouter::RoutingSettings> JsonIO::LoadRoutingSettings() const {
 
-    if (data_.GetRoot().IsMap() &&
-        data_.GetRoot().AsMap().count("routing_settings"s) > 0 &&
-        data_.GetRoot().AsMap().at("routing_settings"s).IsMap()) {
-        auto &routing_settings = data_.GetRoot().AsMap().at("routing_settings"s).AsMap();
+    auto routing_section = GetSection("routing_settings"s);
+    if (routing_section && routing_section->IsMap()) {
+        auto &routing_settings = routing_section->AsMap();
         if (routing_settings.count("bus_wait_time"s) && routing_settings.at("bus_wait_time"s).IsInt()
                 &&
             routing_settings.count("bus_velocity"s) && routing_settings.at("bus_velocity"s).IsInt()) {
@@ -71,19 +152,59 @@ std::optional<transport_router::TransportRouter::RoutingSettings> JsonIO::LoadRo
     return std::nullopt;
 }
 
+number_format::Settings JsonIO::LoadNumberFormat() const {
+    number_format::Settings result;
+    auto output_settings = GetSection("output_settings"s);
+    if (!output_settings || !output_settings->IsMap()) {
+        return result;
+    }
+    const auto &data = output_settings->AsMap();
+    if (data.count("number_format"s) != 0 && data.at("number_format"s).IsString()) {
+        const auto &mode = data.at("number_format"s).AsString();
+        if (mode == "shortest"s) {
+            result.mode = number_format::Mode::SHORTEST;
+        } else if (mode == "fixed"s) {
+            result.mode = number_format::Mode::FIXED;
+        } else {
+            result.mode = number_format::Mode::COMPATIBLE;
+        }
+    }
+    if (data.count("precision"s) != 0 && data.at("precision"s).IsInt()) {
+        result.precision = data.at("precision"s).AsInt();
+    }
+    return result;
+}
+
 void JsonIO::AnswerRequests(const transport_catalogue::TransportCatalogue &catalogue,
                             const renderer::RenderSettings &render_settings,
+                            renderer::MapRenderCache &map_cache,
                             transport_router::TransportRouter &router,
                             std::ostream &requests_out) const {
 
+    const auto number_format = LoadNumberFormat();
+
+    // в ленивом режиме читаем запросы прямо из ленты, не строя json::Node
+    if (lazy_data_) {
+        const auto root = lazy_data_->GetRoot();
+        if (root.IsMap()) {
+            const auto requests = root.Find("stat_requests"sv);
+            if (requests && requests->IsArray()) {
+                json::Array answers = LoadAnswers(*requests, catalogue, render_settings, map_cache,
+                                                  router, number_format);
+                json::Print(json::Document(json::Node{std::move(answers)}), requests_out, number_format);
+            }
+        }
+        return;
+    }
+
     // Загружаем запросы, если они есть и формируем ответы
-    if (data_.GetRoot().IsMap() && data_.GetRoot().AsMap().count("stat_requests"s) > 0) {
-        auto &requests = data_.GetRoot().AsMap().at("stat_requests"s);
+    if (auto requests = GetSection("stat_requests"s)) {
         // проверяем, что запросы хранятся в нужном формате
-        if (requests.IsArray()) {
-            json::Array answers = LoadAnswers(requests.AsArray(), catalogue, render_settings, router);
+        if (requests->IsArray()) {
+            json::Array answers = LoadAnswers(requests->AsArray(), catalogue, render_settings, map_cache,
+                                              router, number_format);
             // выводим результат в поток
-            json::Print(json::Document(json::Node{answers}), requests_out);
+            json::Print(json::Document(json::Node{std::move(answers)}), requests_out, number_format);
         }
     }
 }
@@ -179,33 +300,205 @@ renderer::RenderSettings JsonIO::LoadSettings(const json::Dict &data) const {
             result.color_palette.push_back(ReadColor(color));
         }
     }
+    if (data.count("veil_color"s) != 0) {
+        result.veil_color = ReadColor(data.at("veil_color"s));
+    }
+    if (data.count("compact"s) != 0 && data.at("compact"s).IsBool()) {
+        result.compact = data.at("compact"s).AsBool();
+    }
+    if (data.count("coordinate_precision"s) != 0 && data.at("coordinate_precision"s).IsInt()) {
+        result.coordinate_precision = data.at("coordinate_precision"s).AsInt();
+    }
+    if (data.count("simplify_tolerance"s) != 0 && data.at("simplify_tolerance"s).IsDouble()) {
+        result.simplify_tolerance = data.at("simplify_tolerance"s).AsDouble();
+    }
+    if (data.count("compression_level"s) != 0 && data.at("compression_level"s).IsInt()) {
+        result.compression_level = std::clamp(data.at("compression_level"s).AsInt(), 0, 9);
+    }
     return result;
 }
 
+JsonIO::StreamStats JsonIO::AnswerRequestStream(const transport_catalogue::TransportCatalogue &catalogue,
+                                                const renderer::RenderSettings &render_settings,
+                                                renderer::MapRenderCache &map_cache,
+                                                transport_router::TransportRouter &router,
+                                                std::istream &requests_in,
+                                                std::ostream &answers_out,
+                                                size_t flush_batch) const {
+    using Clock = std::chrono::steady_clock;
+
+    const auto number_format = LoadNumberFormat();
+    StreamStats stats;
+    size_t unflushed = 0;
+    std::string line;
+    // в памяти одновременно находится только текущая строка и ответ на неё
+    while (std::getline(requests_in, line)) {
+        if (std::all_of(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); })) {
+            continue;
+        }
+        const auto start = Clock::now();
+
+        json::Node answer;
+        try {
+            const json::LazyDocument request(std::move(line));
+            answer = LoadAnswer(request.GetRoot(), catalogue, render_settings, map_cache, router, number_format);
+        } catch (const json::ParsingError&) {
+        }
+        // на каждую строку выводится ровно одна строка ответа, чтобы ответы можно было сопоставить с запросами
+        if (answer.IsNull()) {
+            answer = json::Dict{{"error_message"s, json::Node{"invalid request"s}}};
+        }
+        json::PrintCompact(answer, answers_out, number_format);
+        answers_out.put('\n');
+        if (++unflushed >= flush_batch) {
+            answers_out.flush();
+            unflushed = 0;
+        }
+
+        stats.Add(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+        line.clear();
+    }
+    answers_out.flush();
+    return stats;
+}
+
+void JsonIO::StreamStats::Add(uint64_t latency_us) {
+    ++count;
+    total_us += latency_us;
+    max_us = std::max(max_us, latency_us);
+    size_t bucket = 0;
+    while (bucket + 1 < histogram.size() && (uint64_t{1} << bucket) <= latency_us) {
+        ++bucket;
+    }
+    ++histogram[bucket];
+}
+
+uint64_t JsonIO::StreamStats::Percentile(double fraction) const {
+    const auto rank = static_cast<uint64_t>(fraction * static_cast<double>(count));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+        seen += histogram[bucket];
+        if (seen > rank) {
+            return std::min(uint64_t{1} << bucket, max_us);
+        }
+    }
+    return max_us;
+}
+
+std::ostream& operator<<(std::ostream &out, const JsonIO::StreamStats &stats) {
+    out << "requests: "sv << stats.count;
+    if (stats.count > 0) {
+        out << ", mean: "sv << stats.total_us / stats.count << " us"sv
+            << ", p50: <="sv << stats.Percentile(0.5) << " us"sv
+            << ", p99: <="sv << stats.Percentile(0.99) << " us"sv
+            << ", max: "sv << stats.max_us << " us"sv;
+    }
+    return out;
+}
+
 json::Array JsonIO::LoadAnswers(const json::Array &requests,
                                 const transport_catalogue::TransportCatalogue &catalogue,
                                 const renderer::RenderSettings &render_settings,
-                                transport_router::TransportRouter &router) const {
+                                renderer::MapRenderCache &map_cache,
+                                transport_router::TransportRouter &router,
+                                const number_format::Settings &number_format) const {
     json::Array result;
     for (const auto &request : requests) {
         if(IsRouteRequest(request)) {
-            result.push_back(LoadRouteAnswer(request.AsMap(), catalogue));
+            const auto &data = request.AsMap();
+            result.push_back(LoadRouteAnswer(data.at("id"s).AsInt(), data.at("name"s).AsString(), catalogue));
         } else if(IsStopRequest(request)) {
-            result.push_back(LoadStopAnswer(request.AsMap(), catalogue));
+            const auto &data = request.AsMap();
+            result.push_back(LoadStopAnswer(data.at("id"s).AsInt(), data.at("name"s).AsString(), catalogue));
         } else if(IsMapRequest(request)) {
-            result.push_back(LoadMapAnswer(request.AsMap(), catalogue, render_settings));
+            result.push_back(LoadMapAnswer(request.AsMap().at("id"s).AsInt(), catalogue, render_settings,
+                                           map_cache, number_format));
+        } else if(IsMapTileRequest(request)) {
+            result.push_back(LoadMapTileAnswer(request.AsMap(), catalogue, render_settings, map_cache,
+                                               number_format));
         } else if(IsRouteBuildRequest(request)) {
-            result.push_back(LoadRouteBuildAnswer(request.AsMap(), catalogue, router));
+            const auto &data = request.AsMap();
+            result.push_back(LoadRouteBuildAnswer(data.at("id"s).AsInt(), data.at("from"s).AsString(),
+                                                  data.at("to"s).AsString(), catalogue, router));
+        } else if(IsRouteMapRequest(request)) {
+            const auto &data = request.AsMap();
+            result.push_back(LoadRouteMapAnswer(data.at("id"s).AsInt(), data.at("from"s).AsString(),
+                                                data.at("to"s).AsString(), catalogue, render_settings,
+                                                map_cache, router, number_format));
+        }
+    }
+    return result;
+}
+
+json::Array JsonIO::LoadAnswers(const json::LazyNode &requests,
+                                const transport_catalogue::TransportCatalogue &catalogue,
+                                const renderer::RenderSettings &render_settings,
+                                renderer::MapRenderCache &map_cache,
+                                transport_router::TransportRouter &router,
+                                const number_format::Settings &number_format) const {
+    json::Array result;
+    for (const auto request : requests) {
+        auto answer = LoadAnswer(request, catalogue, render_settings, map_cache, router, number_format);
+        if (!answer.IsNull()) {
+            result.push_back(std::move(answer));
         }
     }
     return result;
 }
 
-json::Dict JsonIO::LoadRouteAnswer(const json::Dict &request,
+json::Node JsonIO::LoadAnswer(const json::LazyNode &request,
+                                             const transport_catalogue::TransportCatalogue &catalogue,
+                                             const renderer::RenderSettings &render_settings,
+                                             renderer::MapRenderCache &map_cache,
+                                             transport_router::TransportRouter &router,
+                                             const number_format::Settings &number_format) const {
+    // пропускаем запросы без типа или идентификатора, как и в DOM-режиме
+    if (!request.IsMap()) {
+        return json::Node{};
+    }
+    const auto type = ReadString(request, "type"sv);
+    const auto id_node = request.Find("id"sv);
+    if (!type || !id_node || !id_node->IsInt()) {
+        return json::Node{};
+    }
+    const int id = id_node->AsInt();
+
+    if (*type == "Bus"sv) {
+        if (auto name = ReadString(request, "name"sv)) {
+            return LoadRouteAnswer(id, *name, catalogue);
+        }
+    } else if (*type == "Stop"sv) {
+        if (auto name = ReadString(request, "name"sv)) {
+            return LoadStopAnswer(id, *name, catalogue);
+        }
+    } else if (*type == "Map"sv) {
+        return LoadMapAnswer(id, catalogue, render_settings, map_cache, number_format);
+    } else if (*type == "MapTile"sv) {
+        // параметры области немногочисленны, поэтому запрос разбирается целиком
+        const auto node = request.Materialize();
+        if (IsMapTileRequest(node)) {
+            return LoadMapTileAnswer(node.AsMap(), catalogue, render_settings, map_cache, number_format);
+        }
+    } else if (*type == "Route"sv) {
+        auto from = ReadString(request, "from"sv);
+        auto to = ReadString(request, "to"sv);
+        if (from && to) {
+            return LoadRouteBuildAnswer(id, *from, *to, catalogue, router);
+        }
+    } else if (*type == "RouteMap"sv) {
+        auto from = ReadString(request, "from"sv);
+        auto to = ReadString(request, "to"sv);
+        if (from && to) {
+            return LoadRouteMapAnswer(id, *from, *to, catalogue, render_settings, map_cache, router,
+                                      number_format);
+        }
+    }
+    return json::Node{};
+}
+
+json::Dict JsonIO::LoadRouteAnswer(int id, const std::string &name,
                                    const transport_catalogue::TransportCatalogue &catalogue) {
 
-    int id = request.at("id"s).AsInt();
-    const auto &name = request.at("name"s).AsString();
     try {
         auto answer = catalogue.GetRouteInfo(name);
         // если маршрут существует - возвращаем данные о нём
@@ -222,11 +515,9 @@ json::Dict JsonIO::LoadRouteAnswer(const json::Dict &request,
     }
 }
 
-json::Dict JsonIO::LoadStopAnswer(const json::Dict &request,
+json::Dict JsonIO::LoadStopAnswer(int id, const std::string &name,
                                   const transport_catalogue::TransportCatalogue &catalogue) {
 
-    int id = request.at("id"s).AsInt();
-    const auto &name = request.at("name"s).AsString();
     try {
         auto answer = catalogue.GetBusesOnStop(name);
         //  если остановка существует возвращаем список автобусов через неё проходящих
@@ -246,38 +537,85 @@ json::Dict JsonIO::LoadStopAnswer(const json::Dict &request,
     }
 }
 
-json::Dict JsonIO::LoadMapAnswer(const json::Dict &request,
+json::Dict JsonIO::LoadMapAnswer(int id,
                                  const transport_catalogue::TransportCatalogue &catalogue,
-                                 const renderer::RenderSettings &render_settings) {
-
-    int id = request.at("id"s).AsInt();
-    // формируем карту и выводим её в виде строки
-    std::ostringstream out;
-    renderer::MapRenderer renderer;
-    renderer.SetSettings(render_settings);
-    renderer.RenderMap(catalogue).Render(out);
+                                 const renderer::RenderSettings &render_settings,
+                                 renderer::MapRenderCache &map_cache,
+                                 const number_format::Settings &number_format) {
+
+    // карта перестраивается только при изменении каталога или настроек,
+    // а в ответ попадает разделяемый текст из кэша без копирования;
+    // сжатая карта выводится в base64 под ключом map_svgz
+    return json::Builder{}.StartDict().
+            Key("request_id"s).Value(id).
+            Key(render_settings.compression_level > 0 ? "map_svgz"s : "map"s).Value(map_cache.GetMap(catalogue, render_settings, number_format)).
+    EndDict().Build().AsMap();
+}
+
+json::Dict JsonIO::LoadMapTileAnswer(const json::Dict &request,
+                                     const transport_catalogue::TransportCatalogue &catalogue,
+                                     const renderer::RenderSettings &render_settings,
+                                     renderer::MapRenderCache &map_cache,
+                                     const number_format::Settings &number_format) {
+    const int id = request.at("id"s).AsInt();
+    std::optional<renderer::Viewport> viewport;
+    if (request.count("bbox"s) != 0) {
+        const auto &bbox = request.at("bbox"s).AsArray();
+        const svg::Point min{bbox[0].AsDouble(), bbox[1].AsDouble()};
+        const svg::Point max{bbox[2].AsDouble(), bbox[3].AsDouble()};
+        if (min.x < max.x && min.y < max.y) {
+            viewport = renderer::Viewport{min, max};
+        }
+    } else {
+        viewport = renderer::GetTileViewport(render_settings, request.at("z"s).AsInt(),
+                                             request.at("x"s).AsInt(), request.at("y"s).AsInt());
+    }
+    // если области нет на карте - возвращаем сообщение с ошибкой
+    if (!viewport) {
+        return ErrorMessage(id);
+    }
     return json::Builder{}.StartDict().
             Key("request_id"s).Value(id).
-            Key("map"s).Value(out.str()).
+            Key("map"s).Value(map_cache.GetTile(catalogue, render_settings, *viewport, number_format)).
     EndDict().Build().AsMap();
 }
 
-json::Dict JsonIO::LoadRouteBuildAnswer(const json::Dict &request,
+json::Dict JsonIO::LoadRouteBuildAnswer(int id, const std::string &from, const std::string &to,
                                         const transport_catalogue::TransportCatalogue &catalogue,
                                         transport_router::TransportRouter &router) const {
-    int id = request.at("id"s).AsInt();
-    const auto &from = request.at("from"s).AsString();
-    const auto &to = request.at("to"s).AsString();
+    auto route = router.BuildRoute(from, to);
+    if (!route.has_value()) {
+        return ErrorMessage(id);
+    }
+    return MakeRouteBuildAnswer(id, *route, router.GetSettings().wait_time);
+}
 
+json::Dict JsonIO::LoadRouteMapAnswer(int id, const std::string &from, const std::string &to,
+                                      const transport_catalogue::TransportCatalogue &catalogue,
+                                      const renderer::RenderSettings &render_settings,
+                                      renderer::MapRenderCache &map_cache,
+                                      transport_router::TransportRouter &router,
+                                      const number_format::Settings &number_format) const {
     auto route = router.BuildRoute(from, to);
     if (!route.has_value()) {
         return ErrorMessage(id);
     }
+    std::vector<renderer::RideSegment> ride;
+    ride.reserve(route->size());
+    for (const auto &edge : *route) {
+        ride.push_back({edge.bus_name, edge.stop_from, edge.stop_to, edge.span_count});
+    }
+    // к ответу о маршруте добавляется карта сети с выделенной поездкой
+    auto answer = MakeRouteBuildAnswer(id, *route, router.GetSettings().wait_time);
+    answer.emplace("map"s, map_cache.GetRouteMap(catalogue, render_settings, ride, number_format));
+    return answer;
+}
 
+json::Dict JsonIO::MakeRouteBuildAnswer(int id, const transport_router::TransportRouter::TransportRoute &route,
+                                        int wait_time) {
     double total_time = 0;
-    int wait_time = router.GetSettings().wait_time;
     json::Array items;
-    for (const auto &edge : route.value()) {
+    for (const auto &edge : route) {
         total_time += edge.total_time;
         json::Dict wait_elem = json::Builder{}.StartDict().
             Key("type"s).Value("Wait"s).
@@ -398,12 +736,44 @@ bool JsonIO::IsMapRequest(const json::Node &node) {
     return true;
 }
 
-bool JsonIO::IsRouteBuildRequest(const json::Node &node) {
+bool JsonIO::IsMapTileRequest(const json::Node &node) {
     if(!node.IsMap()) {
         return false;
     }
     const auto &request = node.AsMap();
-    if (request.count("type"s) == 0 || request.at("type"s) != "Route"s) {
+    if (request.count("type"s) == 0 || request.at("type"s) != "MapTile"s) {
+        return false;
+    }
+    if (request.count("id"s) == 0 || !(request.at("id"s).IsInt())) {
+        return false;
+    }
+    // область задаётся прямоугольником bbox: [min_x, min_y, max_x, max_y]
+    if (request.count("bbox"s) != 0) {
+        const auto &bbox = request.at("bbox"s);
+        return bbox.IsArray() && bbox.AsArray().size() == 4
+                && std::all_of(bbox.AsArray().begin(), bbox.AsArray().end(), [](const json::Node &value) {
+                       return value.IsDouble();
+                   });
+    }
+    // либо номером тайла z/x/y
+    for (const auto &key : {"z"s, "x"s, "y"s}) {
+        if (request.count(key) == 0 || !(request.at(key).IsInt())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonIO::IsRouteMapRequest(const json::Node &node) {
+    return IsRouteBuildRequest(node, "RouteMap"s);
+}
+
+bool JsonIO::IsRouteBuildRequest(const json::Node &node, const std::string &type) {
+    if(!node.IsMap()) {
+        return false;
+    }
+    const auto &request = node.AsMap();
+    if (request.count("type"s) == 0 || request.at("type"s) != type) {
         return false;
     }
     if (request.count("id"s) == 0 || !(request.at("id"s).IsInt())) {
@@ -437,6 +807,14 @@ svg::Color JsonIO::ReadColor(const json::Node &color) {
     }
 }
 
+std::optional<std::string> JsonIO::ReadString(const json::LazyNode &node, std::string_view key) {
+    auto value = node.Find(key);
+    if (!value || !value->IsString()) {
+        return std::nullopt;
+    }
+    return value->AsString();
+}
+
 svg::Point JsonIO::ReadOffset(const json::Array &offset) {
     svg::Point result;
     if (offset.size() > 1) {
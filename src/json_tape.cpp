@@ -0,0 +1,837 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// векторное сканирование отключается определением JSON_TAPE_SCALAR_SCAN (опция сборки с тем же именем)
+#if !defined(JSON_TAPE_SCALAR_SCAN) && (defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64))
+#define JSON_TAPE_SSE2_SCAN
+#if defined(__AVX2__)
+#define JSON_TAPE_AVX2_SCAN
+#endif
+#include <immintrin.h>
+#endif
+
+#include "json_tape.h"
+#include "parallel.h"
+
+using namespace std::literals;
+
+namespace json {
+
+namespace {
+
+// ------------- этап 1: построение структурного индекса -------------
+
+constexpr size_t BLOCK_SIZE = 64;
+
+// битовые маски символов одного блока (бит i соответствует символу i блока)
+struct BlockMasks {
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t structural = 0;
+
+    bool operator==(const BlockMasks &other) const {
+        return quote == other.quote && backslash == other.backslash && structural == other.structural;
+    }
+};
+
+inline int TrailingZeros(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+#if defined(JSON_TAPE_AVX2_SCAN)
+
+inline uint64_t MoveMask(__m256i value) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(value));
+}
+
+BlockMasks ScanBlockAvx2(const char *block) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    // '[' | 0x20 == '{', ']' | 0x20 == '}'
+    const __m256i open_bracket = _mm256_set1_epi8('{');
+    const __m256i close_bracket = _mm256_set1_epi8('}');
+
+    BlockMasks result;
+    for (size_t offset = 0; offset < BLOCK_SIZE; offset += 32) {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + offset));
+        const __m256i lowered = _mm256_or_si256(chars, case_bit);
+        const __m256i structural =
+                _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lowered, open_bracket),
+                                                _mm256_cmpeq_epi8(lowered, close_bracket)),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(chars, colon),
+                                                _mm256_cmpeq_epi8(chars, comma)));
+        result.quote |= MoveMask(_mm256_cmpeq_epi8(chars, quote)) << offset;
+        result.backslash |= MoveMask(_mm256_cmpeq_epi8(chars, backslash)) << offset;
+        result.structural |= MoveMask(structural) << offset;
+    }
+    return result;
+}
+
+#endif
+
+#if defined(JSON_TAPE_SSE2_SCAN)
+
+inline uint64_t MoveMask(__m128i value) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(value));
+}
+
+[[maybe_unused]] BlockMasks ScanBlockSse2(const char *block) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    // '[' | 0x20 == '{', ']' | 0x20 == '}'
+    const __m128i open_bracket = _mm_set1_epi8('{');
+    const __m128i close_bracket = _mm_set1_epi8('}');
+
+    BlockMasks result;
+    for (size_t offset = 0; offset < BLOCK_SIZE; offset += 16) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + offset));
+        const __m128i lowered = _mm_or_si128(chars, case_bit);
+        const __m128i structural =
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lowered, open_bracket),
+                                          _mm_cmpeq_epi8(lowered, close_bracket)),
+                             _mm_or_si128(_mm_cmpeq_epi8(chars, colon),
+                                          _mm_cmpeq_epi8(chars, comma)));
+        result.quote |= MoveMask(_mm_cmpeq_epi8(chars, quote)) << offset;
+        result.backslash |= MoveMask(_mm_cmpeq_epi8(chars, backslash)) << offset;
+        result.structural |= MoveMask(structural) << offset;
+    }
+    return result;
+}
+
+#endif
+
+// классы символов для скалярного сканирования
+enum CharClass : uint8_t {
+    OTHER = 0,
+    QUOTE = 1,
+    BACKSLASH = 2,
+    STRUCTURAL = 4,
+};
+
+constexpr std::array<uint8_t, 256> MakeCharClasses() {
+    std::array<uint8_t, 256> result{};
+    result[static_cast<uint8_t>('"')] = QUOTE;
+    result[static_cast<uint8_t>('\\')] = BACKSLASH;
+    for (char c : {'{', '}', '[', ']', ':', ','}) {
+        result[static_cast<uint8_t>(c)] = STRUCTURAL;
+    }
+    return result;
+}
+
+constexpr std::array<uint8_t, 256> CHAR_CLASSES = MakeCharClasses();
+
+// скалярное сканирование компилируется всегда: оно используется без векторных инструкций
+// и служит эталоном для проверки векторных вариантов
+[[maybe_unused]] BlockMasks ScanBlockScalar(const char *block) {
+    BlockMasks result;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const uint8_t char_class = CHAR_CLASSES[static_cast<uint8_t>(block[i])];
+        const uint64_t bit = uint64_t{1} << i;
+        if (char_class & QUOTE) {
+            result.quote |= bit;
+        } else if (char_class & BACKSLASH) {
+            result.backslash |= bit;
+        } else if (char_class & STRUCTURAL) {
+            result.structural |= bit;
+        }
+    }
+    return result;
+}
+
+// сканирует блок самым быстрым из доступных способов;
+// в отладочной сборке результат каждого векторного варианта сверяется со скалярным
+BlockMasks ScanBlock(const char *block) {
+#if defined(JSON_TAPE_AVX2_SCAN)
+    const BlockMasks result = ScanBlockAvx2(block);
+    assert(result == ScanBlockSse2(block));
+#elif defined(JSON_TAPE_SSE2_SCAN)
+    const BlockMasks result = ScanBlockSse2(block);
+#else
+    const BlockMasks result = ScanBlockScalar(block);
+#endif
+    assert(result == ScanBlockScalar(block));
+    return result;
+}
+
+// возвращает маску экранированных символов блока
+// carry - признак того, что первый символ блока экранирован последним символом предыдущего
+// обратные слэши редки, поэтому они обрабатываются поштучно
+uint64_t FindEscaped(uint64_t backslash, bool &carry) {
+    uint64_t escaped = 0;
+    if (carry) {
+        escaped = 1;
+        backslash &= ~uint64_t{1};
+        carry = false;
+    }
+    while (backslash != 0) {
+        const int index = TrailingZeros(backslash);
+        backslash &= backslash - 1;
+        if (static_cast<size_t>(index) == BLOCK_SIZE - 1) {
+            carry = true;
+        } else {
+            const uint64_t next = uint64_t{1} << (index + 1);
+            escaped |= next;
+            // экранированный обратный слэш сам ничего не экранирует
+            backslash &= ~next;
+        }
+    }
+    return escaped;
+}
+
+// префиксный XOR: бит i результата - чётность количества единиц в битах 0..i
+uint64_t PrefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// ---------------- этап 2: построение ленты значений ----------------
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool IsDelimiter(char c) {
+    return IsSpace(c) || c == ',' || c == ']' || c == '}' || c == ':' ||
+           c == '"' || c == '[' || c == '{';
+}
+
+// разбирает строку без кавычек, обрабатывая экранирование так же, как json::Load
+std::string Unescape(std::string_view raw) {
+    std::string result;
+    result.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        const char c = raw[i];
+        if (c != '\\') {
+            result += c;
+            continue;
+        }
+        if (++i == raw.size()) {
+            break;
+        }
+        const char next = raw[i];
+        if (next == '\"') {
+            result += '\"';
+        } else if (next == 'r') {
+            result += '\r';
+        } else if (next == 'n') {
+            result += '\n';
+        } else if (next == 't') {
+            result += '\t';
+        } else if (next == '\\') {
+            result += '\\';
+        }
+    }
+    return result;
+}
+
+bool IsIntToken(std::string_view token) {
+    return token.find_first_of(".eE"sv) == std::string_view::npos;
+}
+
+// проверяет, что токен - число по грамматике JSON, которое json::Load может преобразовать
+// (-?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? без выхода за пределы double)
+bool IsNumberToken(std::string_view token) {
+    size_t pos = 0;
+    auto skip_digits = [&token, &pos] {
+        const size_t begin = pos;
+        while (pos < token.size() && std::isdigit(static_cast<unsigned char>(token[pos]))) {
+            ++pos;
+        }
+        return pos > begin;
+    };
+
+    if (pos < token.size() && token[pos] == '-') {
+        ++pos;
+    }
+    // после 0 в JSON не могут идти другие цифры
+    if (pos < token.size() && token[pos] == '0') {
+        ++pos;
+    } else if (!skip_digits()) {
+        return false;
+    }
+    if (pos < token.size() && token[pos] == '.') {
+        ++pos;
+        if (!skip_digits()) {
+            return false;
+        }
+    }
+    if (pos < token.size() && (token[pos] == 'e' || token[pos] == 'E')) {
+        ++pos;
+        if (pos < token.size() && (token[pos] == '+' || token[pos] == '-')) {
+            ++pos;
+        }
+        if (!skip_digits()) {
+            return false;
+        }
+    }
+    if (pos != token.size()) {
+        return false;
+    }
+    // выйти за пределы double может только число с порядком или очень длинное число
+    if (token.find_first_of("eE"sv) == std::string_view::npos && token.size() < 300) {
+        return true;
+    }
+    double value = 0.0;
+    const auto [ptr, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    return error == std::errc{} && ptr == token.data() + token.size();
+}
+
+} // namespace
+
+std::vector<uint32_t> FindStructurals(std::string_view text) {
+    std::vector<uint32_t> result;
+    result.reserve(text.size() / 8);
+
+    uint64_t prev_in_string = 0;
+    bool escape_carry = false;
+    char tail[BLOCK_SIZE];
+
+    for (size_t base = 0; base < text.size(); base += BLOCK_SIZE) {
+        const char *block = text.data() + base;
+        // последний неполный блок дополняем пробелами
+        if (text.size() - base < BLOCK_SIZE) {
+            std::memset(tail, ' ', BLOCK_SIZE);
+            std::memcpy(tail, block, text.size() - base);
+            block = tail;
+        }
+
+        const BlockMasks masks = ScanBlock(block);
+        const uint64_t quotes = masks.quote & ~FindEscaped(masks.backslash, escape_carry);
+        // бит установлен для символов внутри строк (включая открывающую кавычку)
+        const uint64_t in_string = PrefixXor(quotes) ^ prev_in_string;
+        prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+        uint64_t structurals = (masks.structural & ~in_string) | quotes;
+        while (structurals != 0) {
+            result.push_back(static_cast<uint32_t>(base + TrailingZeros(structurals)));
+            structurals &= structurals - 1;
+        }
+    }
+
+    if (prev_in_string != 0) {
+        throw ParsingError("Failed to parse string node : unexpected end of document"s);
+    }
+    return result;
+}
+
+// ------------------------------------------------------------------
+
+namespace {
+
+// Проходит по тексту и структурному индексу, формируя ленту
+template <typename Entry, typename Type>
+class TapeBuilder {
+public:
+    TapeBuilder(std::string_view text, const std::vector<uint32_t> &structurals,
+                const std::vector<std::string> &root_keys, std::vector<Entry> &tape)
+        : text_(text)
+        , structurals_(structurals)
+        , root_keys_(root_keys)
+        , tape_(tape) {
+    }
+
+    void Build() {
+        ParseValue();
+        SkipSpaces();
+        // проверить что после считывания не осталось лишних символов
+        if (pos_ != text_.size() || index_ != structurals_.size()) {
+            throw ParsingError("Failed to parse document"s);
+        }
+    }
+
+private:
+    void SkipSpaces() {
+        while (pos_ < text_.size() && IsSpace(text_[pos_])) {
+            ++pos_;
+        }
+    }
+
+    char Peek() {
+        SkipSpaces();
+        if (pos_ >= text_.size()) {
+            throw ParsingError("Failed to parse document : unexpected end"s);
+        }
+        return text_[pos_];
+    }
+
+    // забирает очередной структурный символ, который должен совпадать с ожидаемым
+    uint32_t TakeStructural(char expected) {
+        SkipSpaces();
+        if (index_ >= structurals_.size() || structurals_[index_] != pos_ || text_[pos_] != expected) {
+            throw ParsingError("Failed to parse document : expected "s + expected);
+        }
+        ++index_;
+        return static_cast<uint32_t>(pos_++);
+    }
+
+    uint32_t TapeSize() const {
+        return static_cast<uint32_t>(tape_.size());
+    }
+
+    void ParseValue() {
+        switch (Peek()) {
+        case '{':
+            ParseDict();
+            break;
+        case '[':
+            ParseArray();
+            break;
+        case '"':
+            ParseString();
+            break;
+        default:
+            ParseScalar();
+            break;
+        }
+    }
+
+    void ParseString() {
+        const uint32_t open = TakeStructural('"');
+        // закрывающая кавычка - следующий элемент структурного индекса
+        if (index_ >= structurals_.size() || text_[structurals_[index_]] != '"') {
+            throw ParsingError("Failed to parse string node"s);
+        }
+        const uint32_t close = structurals_[index_++];
+        pos_ = close + 1;
+        tape_.push_back({Type::STRING, open + 1, close, TapeSize() + 1});
+    }
+
+    void ParseArray() {
+        const uint32_t self = TapeSize();
+        tape_.push_back({Type::ARRAY, TakeStructural('['), 0, 0});
+        if (Peek() != ']') {
+            while (true) {
+                ParseValue();
+                if (Peek() != ',') {
+                    break;
+                }
+                TakeStructural(',');
+            }
+        }
+        tape_[self].end = TakeStructural(']');
+        tape_[self].next = TapeSize();
+    }
+
+    void ParseDict() {
+        const uint32_t self = TapeSize();
+        // фильтр разделов применяется только к корневому словарю
+        const bool filter_keys = (self == 0 && !root_keys_.empty());
+        tape_.push_back({Type::DICT, TakeStructural('{'), 0, 0});
+        if (Peek() != '}') {
+            while (true) {
+                if (Peek() != '"') {
+                    throw ParsingError("Failed to parse dict key"s);
+                }
+                ParseString();
+                TakeStructural(':');
+                if (filter_keys && !IsRootKeyRequired(tape_.back())) {
+                    SkipValue();
+                } else {
+                    ParseValue();
+                }
+                if (Peek() != ',') {
+                    break;
+                }
+                TakeStructural(',');
+            }
+        }
+        tape_[self].end = TakeStructural('}');
+        tape_[self].next = TapeSize();
+    }
+
+    bool IsRootKeyRequired(const Entry &key) const {
+        const auto raw = text_.substr(key.begin, key.end - key.begin);
+        const auto name = raw.find('\\') == std::string_view::npos ? std::string(raw) : Unescape(raw);
+        return std::find(root_keys_.begin(), root_keys_.end(), name) != root_keys_.end();
+    }
+
+    // пропускает значение, добавляя в ленту только его границы в тексте:
+    // для контейнеров достаточно найти парную скобку в структурном индексе
+    void SkipValue() {
+        const char c = Peek();
+        const size_t begin = pos_;
+        if (c == '"') {
+            TakeStructural('"');
+            if (index_ >= structurals_.size()) {
+                throw ParsingError("Failed to parse string node"s);
+            }
+            pos_ = structurals_[index_++] + 1;
+        } else if (c == '{' || c == '[') {
+            int depth = 0;
+            do {
+                if (index_ >= structurals_.size()) {
+                    throw ParsingError("Failed to parse document : unexpected end"s);
+                }
+                const char current = text_[structurals_[index_]];
+                if (current == '{' || current == '[') {
+                    ++depth;
+                } else if (current == '}' || current == ']') {
+                    --depth;
+                } else if (current == '"') {
+                    // пропускаем строку целиком вместе с закрывающей кавычкой
+                    ++index_;
+                }
+                pos_ = structurals_[index_++] + 1;
+            } while (depth > 0);
+        } else {
+            ParseScalar();
+            tape_.pop_back();
+        }
+        tape_.push_back({Type::RAW, static_cast<uint32_t>(begin), static_cast<uint32_t>(pos_), TapeSize() + 1});
+    }
+
+    void ParseScalar() {
+        const size_t begin = pos_;
+        while (pos_ < text_.size() && !IsDelimiter(text_[pos_])) {
+            ++pos_;
+        }
+        const std::string_view token = text_.substr(begin, pos_ - begin);
+
+        Type type;
+        if (token == "null"sv) {
+            type = Type::NUL;
+        } else if (token == "true"sv || token == "false"sv) {
+            type = Type::BOOL;
+        } else if (IsNumberToken(token)) {
+            type = Type::NUMBER;
+        } else {
+            throw ParsingError("Failed to parse document"s);
+        }
+        tape_.push_back({type, static_cast<uint32_t>(begin), static_cast<uint32_t>(pos_), TapeSize() + 1});
+    }
+
+    std::string_view text_;
+    const std::vector<uint32_t> &structurals_;
+    const std::vector<std::string> &root_keys_;
+    std::vector<Entry> &tape_;
+    size_t pos_ = 0;
+    size_t index_ = 0;
+};
+
+} // namespace
+
+// -------------------------- LazyDocument ---------------------------
+
+LazyDocument::LazyDocument(std::string text, std::vector<std::string> root_keys)
+    : text_(std::move(text)) {
+    // позиции в ленте хранятся в 32 битах
+    if (text_.size() >= std::numeric_limits<uint32_t>::max()) {
+        throw ParsingError("Document is too large for lazy parsing"s);
+    }
+    BuildTape(FindStructurals(text_), root_keys);
+}
+
+void LazyDocument::BuildTape(const std::vector<uint32_t> &structurals,
+                             const std::vector<std::string> &root_keys) {
+    if (root_keys.empty()) {
+        tape_.reserve(structurals.size() / 2 + 1);
+    }
+    TapeBuilder<Entry, Type>(text_, structurals, root_keys, tape_).Build();
+}
+
+LazyNode LazyDocument::GetRoot() const {
+    return {this, 0};
+}
+
+LazyDocument LoadLazy(std::istream &input, std::vector<std::string> root_keys) {
+    std::string text;
+    // если поток позволяет - узнаём размер заранее и читаем одним блоком
+    const auto start = input.tellg();
+    if (start != std::istream::pos_type(-1) && input.seekg(0, std::ios::end)) {
+        const auto size = static_cast<size_t>(input.tellg() - start);
+        input.seekg(start);
+        text.resize(size);
+        input.read(text.data(), static_cast<std::streamsize>(size));
+        text.resize(static_cast<size_t>(input.gcount()));
+    } else {
+        input.clear();
+        text.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    return LazyDocument(std::move(text), std::move(root_keys));
+}
+
+// ----------------------------- LazyNode ----------------------------
+
+const LazyDocument::Entry& LazyNode::GetEntry() const {
+    return document_->tape_[index_];
+}
+
+std::string_view LazyNode::GetText() const {
+    const auto &entry = GetEntry();
+    return std::string_view(document_->text_).substr(entry.begin, entry.end - entry.begin);
+}
+
+bool LazyNode::IsNull() const noexcept {
+    return GetEntry().type == LazyDocument::Type::NUL;
+}
+bool LazyNode::IsBool() const noexcept {
+    return GetEntry().type == LazyDocument::Type::BOOL;
+}
+bool LazyNode::IsInt() const noexcept {
+    if (GetEntry().type != LazyDocument::Type::NUMBER) {
+        return false;
+    }
+    const auto token = GetText();
+    int value;
+    const auto [ptr, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    return IsIntToken(token) && error == std::errc{} && ptr == token.data() + token.size();
+}
+bool LazyNode::IsDouble() const noexcept {
+    return GetEntry().type == LazyDocument::Type::NUMBER;
+}
+bool LazyNode::IsPureDouble() const noexcept {
+    return IsDouble() && !IsInt();
+}
+bool LazyNode::IsString() const noexcept {
+    return GetEntry().type == LazyDocument::Type::STRING;
+}
+bool LazyNode::IsArray() const noexcept {
+    return GetEntry().type == LazyDocument::Type::ARRAY;
+}
+bool LazyNode::IsMap() const noexcept {
+    return GetEntry().type == LazyDocument::Type::DICT;
+}
+bool LazyNode::IsRaw() const noexcept {
+    return GetEntry().type == LazyDocument::Type::RAW;
+}
+
+bool LazyNode::AsBool() const {
+    if (!IsBool()) {
+        throw std::logic_error("Node data is not bool"s);
+    }
+    return GetText() == "true"sv;
+}
+
+int LazyNode::AsInt() const {
+    if (!IsInt()) {
+        throw std::logic_error("Node data is not int"s);
+    }
+    const auto token = GetText();
+    int value = 0;
+    std::from_chars(token.data(), token.data() + token.size(), value);
+    return value;
+}
+
+double LazyNode::AsDouble() const {
+    if (!IsDouble()) {
+        throw std::logic_error("Node data is not double"s);
+    }
+    const auto token = GetText();
+    double value = 0.0;
+    const auto [ptr, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc{} || ptr != token.data() + token.size()) {
+        throw ParsingError("Failed to convert "s + std::string(token) + " to number"s);
+    }
+    return value;
+}
+
+std::string LazyNode::AsString() const {
+    if (!IsString()) {
+        throw std::logic_error("Node data is not string"s);
+    }
+    return Unescape(GetText());
+}
+
+std::string_view LazyNode::AsRawText() const {
+    if (!IsRaw()) {
+        throw std::logic_error("Node data is not raw"s);
+    }
+    return GetText();
+}
+
+bool LazyNode::KeyEquals(std::string_view key) const {
+    const auto raw = GetText();
+    if (raw.find('\\') == std::string_view::npos) {
+        return raw == key;
+    }
+    return Unescape(raw) == key;
+}
+
+std::optional<LazyNode> LazyNode::Find(std::string_view key) const {
+    if (!IsMap()) {
+        throw std::logic_error("Node data is not map"s);
+    }
+    const auto &tape = document_->tape_;
+    // в ленте словаря ключи и значения чередуются
+    for (uint32_t index = index_ + 1; index < GetEntry().next; index = tape[index + 1].next) {
+        LazyNode key_node(document_, index);
+        if (key_node.KeyEquals(key)) {
+            return LazyNode(document_, index + 1);
+        }
+    }
+    return std::nullopt;
+}
+
+LazyNode LazyNode::At(std::string_view key) const {
+    auto result = Find(key);
+    if (!result) {
+        throw std::out_of_range("Key "s + std::string(key) + " does not exist"s);
+    }
+    return *result;
+}
+
+LazyNode::Iterator LazyNode::begin() const {
+    if (!IsArray()) {
+        throw std::logic_error("Node data is not array"s);
+    }
+    return {document_, index_ + 1};
+}
+
+LazyNode::Iterator LazyNode::end() const {
+    if (!IsArray()) {
+        throw std::logic_error("Node data is not array"s);
+    }
+    return {document_, GetEntry().next};
+}
+
+LazyNode::Iterator& LazyNode::Iterator::operator++() {
+    index_ = document_->tape_[index_].next;
+    return *this;
+}
+
+Node LazyNode::Materialize() const {
+    switch (GetEntry().type) {
+    case LazyDocument::Type::NUL:
+        return Node();
+    case LazyDocument::Type::BOOL:
+        return Node(AsBool());
+    case LazyDocument::Type::NUMBER:
+        if (IsInt()) {
+            return Node(AsInt());
+        }
+        return Node(AsDouble());
+    case LazyDocument::Type::STRING:
+        return Node(AsString());
+    case LazyDocument::Type::ARRAY:
+    {
+        Array result;
+        for (const auto &item : *this) {
+            result.push_back(item.Materialize());
+        }
+        return Node(std::move(result));
+    }
+    case LazyDocument::Type::DICT:
+    {
+        Dict result;
+        const auto &tape = document_->tape_;
+        for (uint32_t index = index_ + 1; index < GetEntry().next; index = tape[index + 1].next) {
+            result.insert({LazyNode(document_, index).AsString(),
+                           LazyNode(document_, index + 1).Materialize()});
+        }
+        return Node(std::move(result));
+    }
+    case LazyDocument::Type::RAW:
+        return LazyDocument(std::string(GetText())).GetRoot().Materialize();
+    }
+    return Node();
+}
+
+// ------------------------ LoadArrayParallel ------------------------
+
+Node LoadArrayParallel(std::string_view text, size_t thread_count) {
+    const auto structurals = FindStructurals(text);
+    size_t first = 0;
+    while (first < text.size() && IsSpace(text[first])) {
+        ++first;
+    }
+    if (first == text.size() || text[first] != '[' || structurals.front() != first) {
+        return LazyDocument(std::string(text)).GetRoot().Materialize();
+    }
+
+    // делим массив на части по запятым первого уровня вложенности;
+    // частей берётся больше, чем потоков, чтобы выровнять нагрузку
+    const size_t part_size = text.size() / (std::max<size_t>(thread_count, 1) * 4) + 1;
+    std::vector<std::string_view> parts;
+    size_t part_begin = first + 1;
+    int depth = 0;
+    for (size_t index = 0; index < structurals.size(); ++index) {
+        const size_t pos = structurals[index];
+        const char c = text[pos];
+        if (c == '"') {
+            // пропускаем закрывающую кавычку
+            ++index;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth > 0) {
+                continue;
+            }
+            // массив должен закрываться своей скобкой, после него допустимы только пробельные символы
+            if (c != ']' || index + 1 != structurals.size()) {
+                throw ParsingError("Failed to parse document"s);
+            }
+            for (size_t tail = pos + 1; tail < text.size(); ++tail) {
+                if (!IsSpace(text[tail])) {
+                    throw ParsingError("Failed to parse document"s);
+                }
+            }
+            parts.push_back(text.substr(part_begin, pos - part_begin));
+            break;
+        } else if (c == ',' && depth == 1 && pos - part_begin >= part_size) {
+            parts.push_back(text.substr(part_begin, pos - part_begin));
+            part_begin = pos + 1;
+        }
+    }
+    if (depth != 0) {
+        throw ParsingError("Failed to parse document : unexpected end"s);
+    }
+    // пустая часть между запятыми означает пропущенный элемент ("[1,]", "[1,,2]")
+    if (parts.size() > 1) {
+        for (const auto part : parts) {
+            if (std::all_of(part.begin(), part.end(), IsSpace)) {
+                throw ParsingError("Failed to parse document"s);
+            }
+        }
+    }
+
+    std::vector<Array> results(parts.size());
+    parallel::For(parts.size(), [&parts, &results](size_t index) {
+        std::string part;
+        part.reserve(parts[index].size() + 2);
+        part += '[';
+        part += parts[index];
+        part += ']';
+        const LazyDocument document(std::move(part));
+        auto &result = results[index];
+        for (const auto &item : document.GetRoot()) {
+            result.push_back(item.Materialize());
+        }
+    }, thread_count);
+
+    size_t total = 0;
+    for (const auto &result : results) {
+        total += result.size();
+    }
+    Array merged;
+    merged.reserve(total);
+    for (auto &result : results) {
+        std::move(result.begin(), result.end(), std::back_inserter(merged));
+        Array().swap(result);
+    }
+    return Node(std::move(merged));
+}
+
+} // namespace json
@@ -1,5 +1,10 @@
 #include "map_renderer.h"
 
+#include "gzip.h"
+
+#include <algorithm>
+#include <limits>
+
 using namespace std::literals;
 
 namespace renderer {
@@ -13,134 +18,445 @@ bool IsZero(double value) {
 
 } // namespace
 
+bool operator==(const RenderSettings &lhs, const RenderSettings &rhs) {
+    return lhs.size == rhs.size
+            && lhs.padding == rhs.padding
+            && lhs.line_width == rhs.line_width
+            && lhs.stop_radius == rhs.stop_radius
+            && lhs.bus_label_font_size == rhs.bus_label_font_size
+            && lhs.bus_label_offset == rhs.bus_label_offset
+            && lhs.stop_label_font_size == rhs.stop_label_font_size
+            && lhs.stop_label_offset == rhs.stop_label_offset
+            && lhs.underlayer_color == rhs.underlayer_color
+            && lhs.underlayer_width == rhs.underlayer_width
+            && lhs.color_palette == rhs.color_palette
+            && lhs.veil_color == rhs.veil_color
+            && lhs.compact == rhs.compact
+            && lhs.coordinate_precision == rhs.coordinate_precision
+            && lhs.simplify_tolerance == rhs.simplify_tolerance
+            && lhs.compression_level == rhs.compression_level;
+}
+
+bool operator!=(const RenderSettings &lhs, const RenderSettings &rhs) {
+    return !(lhs == rhs);
+}
+
 void MapRenderer::SetSettings(const RenderSettings &settings) {
     settings_ = settings;
 }
 
-svg::Document MapRenderer::RenderMap(const transport_catalogue::TransportCatalogue &catalogue) {
-
-    field_size_ = ComputeFieldSize(catalogue);
+RenderModel MapRenderer::BuildModel(const transport_catalogue::TransportCatalogue &catalogue) {
+    // остановки, через которые проходят маршруты, в порядке имён
+    const auto &buses_on_stops = catalogue.GetBusesOnStops();
+    std::vector<const domain::Stop*> stops;
+    for (const auto &[name, stop] : catalogue.GetStops()) {
+        if (buses_on_stops.count(name) != 0) {
+            stops.push_back(stop);
+        }
+    }
+    std::sort(stops.begin(), stops.end(), [](const domain::Stop *lhs, const domain::Stop *rhs) {
+        return lhs->name < rhs->name;
+    });
 
-    const auto &routes = catalogue.GetRoutes();
-    const auto &stops = catalogue.GetStops();
+    field_size_ = ComputeFieldSize(stops);
 
-    // перекладываем в map, для упорядочивания по имени
-    Routes sorted_routes;
-    Stops sorted_stops;
-    for (auto &route : routes) {
-        sorted_routes.insert(route);
+    RenderModel model;
+    model.stops.reserve(stops.size());
+    std::unordered_map<const domain::Stop*, uint32_t> stop_ids;
+    for (const auto *stop : stops) {
+        stop_ids.emplace(stop, static_cast<uint32_t>(model.stops.size()));
+        model.stops.push_back({stop->name, GetRelativePoint(stop->coordinate)});
     }
-    for (auto &stop : stops) {
-        sorted_stops.insert(stop);
+
+    // непустые маршруты в порядке имён
+    for (const auto &[name, route] : catalogue.GetRoutes()) {
+        if (!route->stops.empty()) {
+            model.routes.push_back({name, route->route_type, {}});
+            auto &route_stops = model.routes.back().stops;
+            route_stops.reserve(route->stops.size());
+            for (const auto *stop : route->stops) {
+                route_stops.push_back(stop_ids.at(stop));
+            }
+        }
     }
+    std::sort(model.routes.begin(), model.routes.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.name < rhs.name;
+    });
+    return model;
+}
 
-    const auto &buses_on_stops = catalogue.GetBusesOnStops();
+svg::Document MapRenderer::RenderMap(const transport_catalogue::TransportCatalogue &catalogue) {
+    return RenderMap(BuildModel(catalogue));
+}
 
+svg::Document MapRenderer::RenderMap(const RenderModel &model) const {
     svg::Document doc;
-    RenderLines(doc, sorted_routes);
-    RenderRouteNames(doc, sorted_routes);
-    RenderStops(doc, sorted_stops, buses_on_stops);
-    RenderStopNames(doc, sorted_stops, buses_on_stops);
+    if (settings_.compact) {
+        RenderCompactStyle(doc);
+    }
+    RenderLines(doc, model, 0, model.routes.size());
+    RenderRouteNames(doc, model, 0, model.routes.size());
+    RenderStops(doc, model, 0, model.stops.size());
+    RenderStopNames(doc, model, 0, model.stops.size());
     return doc;
 }
 
-void MapRenderer::RenderLines(svg::Document& doc, const Routes &routes) const {
-    auto max_color_count = settings_.color_palette.size();
-    size_t color_index = 0;
-    for (const auto &route : routes) {
-        // работает только не с пустыми маршрутами
-        if (route.second->stops.size() > 0) {
-            // задаём параметры рисования линии
-            svg::Polyline line;
-            line.SetStrokeColor(settings_.color_palette.at(color_index % max_color_count)).
-                    SetFillColor(svg::NoneColor).SetStrokeWidth(settings_.line_width).
-                    SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-            // проходим по маршруту, добавляя точки от первой остановки до последней
-            for (auto iter = route.second->stops.begin(); iter < route.second->stops.end(); ++iter) {
-                line.AddPoint(GetRelativePoint((*iter)->coordinate));
+void MapRenderer::RenderMap(const RenderModel &model, std::string &out,
+                            const number_format::Settings &number_format, size_t thread_count) const {
+    if (thread_count <= 1) {
+        RenderMap(model).Render(out, number_format);
+        return;
+    }
+    RenderMap(model, [&out](std::string_view chunk) {
+        out += chunk;
+    }, number_format, thread_count);
+}
+
+void MapRenderer::RenderMap(const RenderModel &model, const std::function<void(std::string_view)> &sink,
+                            const number_format::Settings &number_format, size_t thread_count) const {
+    // части слоёв в порядке вывода: слой и диапазон маршрутов или остановок
+    enum class Layer { LINES, ROUTE_NAMES, STOPS, STOP_NAMES };
+    struct Part {
+        Layer layer;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<Part> parts;
+    // при параллельной отрисовке слой делится примерно на thread_count * 2 части,
+    // чтобы потоки догружали друг друга; при последовательной - на части постоянного размера,
+    // чтобы в памяти был текст только одной части
+    auto split = [&parts, thread_count](Layer layer, size_t count) {
+        const size_t part_size = thread_count <= 1
+                ? 256
+                : std::max<size_t>(64, (count + thread_count * 2 - 1) / (thread_count * 2));
+        for (size_t begin = 0; begin < count; begin += part_size) {
+            parts.push_back({layer, begin, std::min(begin + part_size, count)});
+        }
+    };
+    split(Layer::LINES, model.routes.size());
+    split(Layer::ROUTE_NAMES, model.routes.size());
+    split(Layer::STOPS, model.stops.size());
+    split(Layer::STOP_NAMES, model.stops.size());
+
+    auto render_part = [&](const Part &part, std::string &buffer) {
+        svg::Document doc;
+        switch (part.layer) {
+        case Layer::LINES:
+            RenderLines(doc, model, part.begin, part.end);
+            break;
+        case Layer::ROUTE_NAMES:
+            RenderRouteNames(doc, model, part.begin, part.end);
+            break;
+        case Layer::STOPS:
+            RenderStops(doc, model, part.begin, part.end);
+            break;
+        case Layer::STOP_NAMES:
+            RenderStopNames(doc, model, part.begin, part.end);
+            break;
+        }
+        doc.RenderObjects(buffer, number_format);
+    };
+
+    // начало документа и таблица стилей
+    std::string buffer;
+    // в компактном режиме значки остановок выводятся элементами <use>
+    svg::Document::RenderBegin(buffer, settings_.compact);
+    if (settings_.compact) {
+        svg::Document style;
+        RenderCompactStyle(style);
+        style.RenderObjects(buffer, number_format);
+    }
+    sink(buffer);
+    buffer.clear();
+
+    if (thread_count <= 1) {
+        for (const auto &part : parts) {
+            render_part(part, buffer);
+            sink(buffer);
+            buffer.clear();
+        }
+    } else {
+        std::vector<std::string> buffers(parts.size());
+        parallel::For(parts.size(), [&](size_t index) {
+            render_part(parts[index], buffers[index]);
+        }, thread_count);
+        // выводим части в каноническом порядке
+        for (const auto &part_buffer : buffers) {
+            sink(part_buffer);
+        }
+    }
+
+    svg::Document::RenderEnd(buffer);
+    sink(buffer);
+}
+
+void MapRenderer::RenderLines(svg::Document& doc, const RenderModel &model, size_t begin, size_t end) const {
+    const double tolerance = settings_.simplify_tolerance;
+    std::vector<svg::Point> points;
+    for (size_t color_index = begin; color_index < end; ++color_index) {
+        const auto &route = model.routes[color_index];
+        points.clear();
+        // проходим по маршруту, добавляя точки от первой остановки до последней
+        for (const auto stop : route.stops) {
+            points.push_back(model.stops[stop].point);
+        }
+        // проходим по маршруту назад если он не кольцевой
+        // при упрощении обратный ход не выводится: он совпадает с прямым и не меняет вида линии
+        if (route.route_type == domain::RouteType::LINEAR && tolerance <= 0.0) {
+            for (auto iter = std::next(route.stops.rbegin()); iter < route.stops.rend(); ++iter) {
+                points.push_back(model.stops[*iter].point);
             }
-            // проходим по маршруту назад если он не кольцевой
-            if (route.second->route_type == domain::RouteType::LINEAR) {
-                for (auto iter = std::next(route.second->stops.rbegin()); iter < route.second->stops.rend(); ++iter) {
-                    line.AddPoint(GetRelativePoint((*iter)->coordinate));
+        }
+        if (tolerance > 0.0) {
+            const auto weights = ComputeSimplificationWeights(points);
+            size_t count = 0;
+            for (size_t i = 0; i < points.size(); ++i) {
+                if (weights[i] > tolerance) {
+                    points[count++] = points[i];
                 }
             }
-            doc.Add(line);
-            ++color_index;
-        }
-    }
-}
-
-void MapRenderer::RenderRouteNames(svg::Document &doc, const Routes &routes) const {
-    auto max_color_count = settings_.color_palette.size();
-    size_t color_index = 0;
-    for (const auto &route : routes) {
-        // работает только не с пустыми маршрутами
-        if (route.second->stops.size() > 0) {
-            // задаем общие параметры отрисовки текста и подложки
-            svg::Text text, underlayer_text;
-            text.SetData(std::string(route.first)).
-                    SetPosition(GetRelativePoint(route.second->stops.front()->coordinate)).
-                    SetOffset(settings_.bus_label_offset).
-                    SetFontSize(static_cast<std::uint32_t>(settings_.bus_label_font_size)).
-                    SetFontFamily("Verdana"s).SetFontWeight("bold");
-            underlayer_text = text;
-            // добавляем индивидуальные для текста и подложки параметры
-            text.SetFillColor(settings_.color_palette.at(color_index % max_color_count));
-            underlayer_text.SetFillColor(settings_.underlayer_color).SetStrokeColor(settings_.underlayer_color).
-                    SetStrokeWidth(settings_.underlayer_width).
-                    SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-            // отрисовываем название маршрута у первой остановки
-            doc.Add(underlayer_text);
-            doc.Add(text);
-            // если маршрут не кольцевой и первая остановка не совпадает с последней
-            // то отрисовываем название маршрута у последней остановки
-            if (route.second->route_type == domain::RouteType::LINEAR &&
-                    route.second->stops.back() != route.second->stops.front()) {
-                text.SetPosition(GetRelativePoint(route.second->stops.back()->coordinate));
-                underlayer_text.SetPosition(GetRelativePoint(route.second->stops.back()->coordinate));
-                doc.Add(underlayer_text);
-                doc.Add(text);
-            }
-            ++color_index;
+            points.resize(count);
         }
+        AddLine(doc, points, color_index);
     }
 }
 
-void MapRenderer::RenderStops(svg::Document &doc, const Stops &stops, const BusesOnStops &buses_on_stops) const {
-    for (const auto &stop : stops) {
-        // проходим по всем остановкам, которые входят в какой либо маршрут
-        if (buses_on_stops.count(stop.first) != 0) {
-            // отрисовываем значок остановки
-            svg::Circle circle;
-            circle.SetCenter(GetRelativePoint(stop.second->coordinate)).
-                    SetRadius(settings_.stop_radius).SetFillColor("white"s);
-            doc.Add(circle);
+void MapRenderer::RenderRouteNames(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const {
+    for (size_t color_index = begin; color_index < end; ++color_index) {
+        const auto &route = model.routes[color_index];
+        // отрисовываем название маршрута у первой остановки
+        AddRouteLabel(doc, route.name, model.stops[route.stops.front()].point, color_index);
+        // если маршрут не кольцевой и первая остановка не совпадает с последней
+        // то отрисовываем название маршрута у последней остановки
+        if (route.route_type == domain::RouteType::LINEAR && route.stops.back() != route.stops.front()) {
+            AddRouteLabel(doc, route.name, model.stops[route.stops.back()].point, color_index);
+        }
+    }
+}
+
+void MapRenderer::RenderStops(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const {
+    for (size_t i = begin; i < end; ++i) {
+        AddStop(doc, model.stops[i].point);
+    }
+}
+
+void MapRenderer::RenderStopNames(svg::Document &doc, const RenderModel &model, size_t begin, size_t end) const {
+    for (size_t i = begin; i < end; ++i) {
+        AddStopLabel(doc, model.stops[i].name, model.stops[i].point);
+    }
+}
+
+void MapRenderer::RenderRideOverlay(svg::Document &doc, const RenderModel &model,
+                                    const std::vector<RideSegment> &ride) const {
+    // полупрозрачная подложка приглушает карту под поездкой
+    doc.Add(svg::Rect().SetPosition({0.0, 0.0}).SetSize(settings_.size).SetFillColor(settings_.veil_color));
+
+    // маршруты и остановки модели упорядочены по именам, поэтому ищутся двоичным поиском
+    auto find_route = [&model](std::string_view name) -> std::optional<size_t> {
+        auto iter = std::lower_bound(model.routes.begin(), model.routes.end(), name,
+                                     [](const RenderModel::Route &route, std::string_view value) {
+            return route.name < value;
+        });
+        if (iter == model.routes.end() || iter->name != name) {
+            return std::nullopt;
+        }
+        return static_cast<size_t>(iter - model.routes.begin());
+    };
+    auto find_stop = [&model](std::string_view name) -> std::optional<uint32_t> {
+        auto iter = std::lower_bound(model.stops.begin(), model.stops.end(), name,
+                                     [](const RenderModel::Stop &stop, std::string_view value) {
+            return stop.name < value;
+        });
+        if (iter == model.stops.end() || iter->name != name) {
+            return std::nullopt;
+        }
+        return static_cast<uint32_t>(iter - model.stops.begin());
+    };
+
+    // остановки участков в порядке поездки и остановки посадки и высадки
+    std::vector<uint32_t> ride_stops;
+    std::vector<uint32_t> labeled_stops;
+    std::vector<svg::Point> points;
+    for (const auto &segment : ride) {
+        const auto route_index = find_route(segment.bus);
+        const auto from = find_stop(segment.stop_from);
+        const auto to = find_stop(segment.stop_to);
+        if (!route_index || !from || !to || segment.span_count == 0) {
+            continue;
+        }
+        // обход маршрута: для некольцевого - туда и обратно
+        const auto &stops = model.routes[*route_index].stops;
+        const bool is_linear = model.routes[*route_index].route_type == domain::RouteType::LINEAR;
+        const size_t length = is_linear ? stops.size() * 2 - 1 : stops.size();
+        auto stop_at = [&stops](size_t position) {
+            return position < stops.size() ? stops[position] : stops[stops.size() * 2 - 2 - position];
+        };
+        // на обратном ходе некольцевого маршрута маршрутизатор выдаёт отрицательное число перегонов
+        const auto span = static_cast<size_t>(std::abs(segment.span_count));
+        // участок начинается с первого вхождения остановки посадки, от которого за span перегонов
+        // маршрут приходит на остановку высадки
+        size_t begin = 0;
+        while (begin + span < length && (stop_at(begin) != *from || stop_at(begin + span) != *to)) {
+            ++begin;
+        }
+        if (begin + span >= length) {
+            continue;
+        }
+
+        points.clear();
+        for (size_t position = begin; position <= begin + span; ++position) {
+            const auto stop = stop_at(position);
+            points.push_back(model.stops[stop].point);
+            if (ride_stops.empty() || ride_stops.back() != stop) {
+                ride_stops.push_back(stop);
+            }
         }
+        AddLine(doc, points, *route_index);
+        labeled_stops.push_back(*from);
+        labeled_stops.push_back(*to);
+    }
+
+    for (const auto stop : ride_stops) {
+        AddStop(doc, model.stops[stop].point);
+    }
+    // у пересадки высадка с одного участка совпадает с посадкой на следующий
+    labeled_stops.erase(std::unique(labeled_stops.begin(), labeled_stops.end()), labeled_stops.end());
+    for (const auto stop : labeled_stops) {
+        AddStopLabel(doc, model.stops[stop].name, model.stops[stop].point);
     }
 }
 
-void MapRenderer::RenderStopNames(svg::Document &doc, const Stops &stops, const BusesOnStops &buses_on_stops) const {
-    for (const auto &stop : stops) {
-        // проходим по всем остановкам, которые входят в какой либо маршрут
-        if (buses_on_stops.count(stop.first) != 0) {
-            // формируем текст и подложку
-            svg::Text text, underlayer_text;
-            text.SetData(std::string(stop.first)).SetPosition(GetRelativePoint(stop.second->coordinate)).
-                    SetOffset(settings_.stop_label_offset).
-                    SetFontSize(static_cast<std::uint32_t>(settings_.stop_label_font_size)).
-                    SetFontFamily("Verdana");
-            underlayer_text = text;
-            // добавляем индивидуальные для текста и подложки параметры
-            text.SetFillColor("black");
-            underlayer_text.SetFillColor(settings_.underlayer_color).SetStrokeColor(settings_.underlayer_color).
-                    SetStrokeWidth(settings_.underlayer_width).
-                    SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-            // отрисовываем подложку и текст
-            doc.Add(underlayer_text);
-            doc.Add(text);
+size_t MapRenderer::GetPaletteIndex(size_t color_index) const {
+    return settings_.color_palette.empty() ? 0 : color_index % settings_.color_palette.size();
+}
+
+void MapRenderer::AddLine(svg::Document &doc, const std::vector<svg::Point> &points, size_t color_index) const {
+    svg::Polyline line;
+    if (settings_.compact) {
+        line.SetClass("l c"s + std::to_string(GetPaletteIndex(color_index)));
+        for (const auto &point : points) {
+            line.AddPoint(Quantize(point));
         }
+    } else {
+        // задаём параметры рисования линии
+        line.SetStrokeColor(settings_.color_palette.empty()
+                            ? svg::NoneColor : settings_.color_palette[GetPaletteIndex(color_index)]).
+                SetFillColor(svg::NoneColor).SetStrokeWidth(settings_.line_width).
+                SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        for (const auto &point : points) {
+            line.AddPoint(point);
+        }
+    }
+    doc.Add(std::move(line));
+}
+
+void MapRenderer::AddRouteLabel(svg::Document &doc, std::string_view name, svg::Point pos,
+                                size_t color_index) const {
+    if (settings_.compact) {
+        pos = Quantize({pos.x + settings_.bus_label_offset.x, pos.y + settings_.bus_label_offset.y});
+        doc.Add(svg::Label().SetClass("b f"s + std::to_string(GetPaletteIndex(color_index))).
+                SetPosition(pos).SetData(std::string(name)));
+        return;
+    }
+    // задаем общие параметры отрисовки текста и подложки
+    svg::Text text, underlayer_text;
+    text.SetData(std::string(name)).SetPosition(pos).
+            SetOffset(settings_.bus_label_offset).
+            SetFontSize(static_cast<std::uint32_t>(settings_.bus_label_font_size)).
+            SetFontFamily("Verdana"s).SetFontWeight("bold");
+    underlayer_text = text;
+    // добавляем индивидуальные для текста и подложки параметры
+    if (!settings_.color_palette.empty()) {
+        text.SetFillColor(settings_.color_palette[GetPaletteIndex(color_index)]);
+    }
+    underlayer_text.SetFillColor(settings_.underlayer_color).SetStrokeColor(settings_.underlayer_color).
+            SetStrokeWidth(settings_.underlayer_width).
+            SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    doc.Add(std::move(underlayer_text));
+    doc.Add(std::move(text));
+}
+
+void MapRenderer::AddStop(svg::Document &doc, svg::Point pos) const {
+    if (settings_.compact) {
+        doc.Add(svg::Use().SetHref("s"s).SetPosition(Quantize(pos)));
+        return;
+    }
+    // отрисовываем значок остановки
+    svg::Circle circle;
+    circle.SetCenter(pos).SetRadius(settings_.stop_radius).SetFillColor("white"s);
+    doc.Add(circle);
+}
+
+void MapRenderer::AddStopLabel(svg::Document &doc, std::string_view name, svg::Point pos) const {
+    if (settings_.compact) {
+        pos = Quantize({pos.x + settings_.stop_label_offset.x, pos.y + settings_.stop_label_offset.y});
+        doc.Add(svg::Label().SetClass("n"s).SetPosition(pos).SetData(std::string(name)));
+        return;
+    }
+    // формируем текст и подложку
+    svg::Text text, underlayer_text;
+    text.SetData(std::string(name)).SetPosition(pos).
+            SetOffset(settings_.stop_label_offset).
+            SetFontSize(static_cast<std::uint32_t>(settings_.stop_label_font_size)).
+            SetFontFamily("Verdana");
+    underlayer_text = text;
+    // добавляем индивидуальные для текста и подложки параметры
+    text.SetFillColor("black");
+    underlayer_text.SetFillColor(settings_.underlayer_color).SetStrokeColor(settings_.underlayer_color).
+            SetStrokeWidth(settings_.underlayer_width).
+            SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    // отрисовываем подложку и текст
+    doc.Add(std::move(underlayer_text));
+    doc.Add(std::move(text));
+}
+
+/*
+ * Компактный режим.
+ * Классы таблицы стилей:
+ *   l  - линия маршрута, cN - цвет линии N-го цвета палитры;
+ *   b  - название маршрута, fN - цвет названия N-го цвета палитры;
+ *   n  - название остановки.
+ * Подложка под текст рисуется тем же элементом <text>: обводка цвета подложки выводится под заливкой
+ * (paint-order: stroke). Результат совпадает с отдельным элементом-подложкой, кроме полупрозрачных
+ * цветов текста, сквозь которые подложка видна только у контуров букв.
+ * Значок остановки определён один раз в <defs> с id "s".
+ * Смещения подписей прибавляются к координатам, поэтому атрибуты dx и dy не выводятся
+ */
+
+void MapRenderer::RenderCompactStyle(svg::Document &doc) const {
+    std::string css;
+    svg::Writer out(css);
+    svg::RenderContext ctx(out);
+
+    out << ".l{fill:none;stroke-width:"sv << ctx.Format(settings_.line_width)
+        << ";stroke-linecap:round;stroke-linejoin:round}"sv;
+    out << ".b,.n{font-family:Verdana;stroke:"sv;
+    svg::PrintColor(ctx, settings_.underlayer_color);
+    out << ";stroke-width:"sv << ctx.Format(settings_.underlayer_width)
+        << ";stroke-linecap:round;stroke-linejoin:round;paint-order:stroke}"sv;
+    out << ".b{font-size:"sv << settings_.bus_label_font_size << "px;font-weight:bold}"sv;
+    out << ".n{font-size:"sv << settings_.stop_label_font_size << "px;fill:black}"sv;
+    for (size_t i = 0; i < settings_.color_palette.size(); ++i) {
+        const int index = static_cast<int>(i);
+        out << ".c"sv << index << "{stroke:"sv;
+        svg::PrintColor(ctx, settings_.color_palette[i]);
+        out << "}.f"sv << index << "{fill:"sv;
+        svg::PrintColor(ctx, settings_.color_palette[i]);
+        out << '}';
     }
+
+    svg::Style style;
+    style.SetContent(std::move(css));
+    doc.Add(std::move(style));
+
+    svg::Defs defs;
+    defs.Add(svg::Circle().SetCenter({0, 0}).SetRadius(settings_.stop_radius).SetFillColor("white"s).SetId("s"s));
+    doc.Add(std::move(defs));
+}
+
+svg::Point MapRenderer::Quantize(svg::Point point) const {
+    const double scale = std::pow(10.0, settings_.coordinate_precision);
+    return {std::round(point.x * scale) / scale, std::round(point.y * scale) / scale};
 }
 
 svg::Point MapRenderer::GetRelativePoint(geo::Coordinates coordinate) const {
@@ -167,27 +483,492 @@ svg::Point MapRenderer::GetRelativePoint(geo::Coordinates coordinate) const {
 }
 
 std::pair<geo::Coordinates, geo::Coordinates>
-MapRenderer::ComputeFieldSize(const transport_catalogue::TransportCatalogue &catalogue) const {
+MapRenderer::ComputeFieldSize(const std::vector<const domain::Stop*> &stops) const {
     geo::Coordinates min{90.0, 180.0};
     geo::Coordinates max{-90.0, -180.0};
-    for (const auto &stop : catalogue.GetStops()) {
-        if (catalogue.GetBusesOnStop(std::string(stop.first))) {
-            const auto &coordinates = stop.second->coordinate;
-            if (coordinates.lat < min.lat) {
-                min.lat = coordinates.lat;
+    for (const auto *stop : stops) {
+        const auto &coordinates = stop->coordinate;
+        if (coordinates.lat < min.lat) {
+            min.lat = coordinates.lat;
+        }
+        if (coordinates.lat > max.lat) {
+            max.lat = coordinates.lat;
+        }
+        if (coordinates.lng < min.lng) {
+            min.lng = coordinates.lng;
+        }
+        if (coordinates.lng > max.lng) {
+            max.lng = coordinates.lng;
+        }
+    }
+    return std::pair<geo::Coordinates, geo::Coordinates>{min, max};
+}
+
+std::vector<double> ComputeSimplificationWeights(const std::vector<svg::Point> &points) {
+    std::vector<double> weights(points.size(), std::numeric_limits<double>::infinity());
+    if (points.size() < 3) {
+        return weights;
+    }
+    // расстояние от точки до отрезка [a, b]
+    auto distance = [](svg::Point p, svg::Point a, svg::Point b) {
+        const double dx = b.x - a.x;
+        const double dy = b.y - a.y;
+        const double length = dx * dx + dy * dy;
+        double t = IsZero(length) ? 0.0 : ((p.x - a.x) * dx + (p.y - a.y) * dy) / length;
+        t = std::clamp(t, 0.0, 1.0);
+        return std::hypot(p.x - a.x - t * dx, p.y - a.y - t * dy);
+    };
+
+    // Дуглас-Пекер без порога: каждый участок делится в самой удалённой вершине до конца.
+    // Вершина остаётся при допуске t, если при t делятся все охватывающие её участки,
+    // поэтому её вес - минимум из её удаления и веса вершины, разделившей участок
+    struct Range {
+        size_t first;
+        size_t last;
+        double weight;
+    };
+    std::vector<Range> ranges{{0, points.size() - 1, std::numeric_limits<double>::infinity()}};
+    while (!ranges.empty()) {
+        const auto [first, last, weight] = ranges.back();
+        ranges.pop_back();
+        if (last - first < 2) {
+            continue;
+        }
+        size_t farthest = first + 1;
+        double max_distance = -1.0;
+        for (size_t i = first + 1; i < last; ++i) {
+            const double d = distance(points[i], points[first], points[last]);
+            if (d > max_distance) {
+                max_distance = d;
+                farthest = i;
             }
-            if (coordinates.lat > max.lat) {
-                max.lat = coordinates.lat;
+        }
+        weights[farthest] = std::min(max_distance, weight);
+        ranges.push_back({first, farthest, weights[farthest]});
+        ranges.push_back({farthest, last, weights[farthest]});
+    }
+    return weights;
+}
+
+// --------------------------- MapTileIndex ----------------------------
+
+namespace {
+
+// наибольший размер сетки индекса по одной стороне
+constexpr double MAX_GRID_SIDE = 1024.0;
+
+// число символов в строке UTF-8
+size_t CountChars(std::string_view text) {
+    return static_cast<size_t>(std::count_if(text.begin(), text.end(), [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    }));
+}
+
+// оценочный прямоугольник подписи относительно точки привязки: ширина символа не больше кегля,
+// высота - от кегля над базовой линией до половины кегля под ней, с учётом подложки
+std::pair<svg::Point, svg::Point> GetLabelBox(svg::Point anchor, std::string_view text, int font_size,
+                                              svg::Point offset, double underlayer_width) {
+    const double size = std::abs(font_size);
+    const double border = underlayer_width / 2;
+    const svg::Point base{anchor.x + offset.x, anchor.y + offset.y};
+    return {{base.x - border, base.y - size - border},
+            {base.x + static_cast<double>(CountChars(text)) * size + border, base.y + size / 2 + border}};
+}
+
+// наибольшее удаление точек прямоугольника от точки привязки
+double GetReach(svg::Point anchor, const std::pair<svg::Point, svg::Point> &box) {
+    return std::max({anchor.x - box.first.x, box.second.x - anchor.x,
+                     anchor.y - box.first.y, box.second.y - anchor.y});
+}
+
+} // namespace
+
+std::optional<Viewport> GetTileViewport(const RenderSettings &settings, int z, int x, int y) {
+    // больше 2^30 тайлов по стороне не помещается в int
+    if (z < 0 || z > 30) {
+        return std::nullopt;
+    }
+    const int64_t count = int64_t{1} << z;
+    if (x < 0 || y < 0 || x >= count || y >= count) {
+        return std::nullopt;
+    }
+    const double width = settings.size.x / static_cast<double>(count);
+    const double height = settings.size.y / static_cast<double>(count);
+    return Viewport{{x * width, y * height}, {(x + 1) * width, (y + 1) * height}};
+}
+
+MapTileIndex::MapTileIndex(const RenderModel &model, const RenderSettings &settings) {
+    renderer_.SetSettings(settings);
+
+    // остановки и маршруты в том же порядке, что и на полной карте
+    stops_.reserve(model.stops.size());
+    for (const auto &stop : model.stops) {
+        stops_.push_back({stop.name, stop.point, {}});
+    }
+
+    size_t segment_count = 0;
+    for (const auto &route : model.routes) {
+        const auto route_id = static_cast<uint32_t>(routes_.size());
+        RouteData data{route.name, {}, {}};
+        for (const auto stop : route.stops) {
+            data.points.push_back(stops_[stop].point);
+        }
+        // как и на полной карте, при упрощении обратный ход некольцевого маршрута не выводится
+        if (route.route_type == domain::RouteType::LINEAR && settings.simplify_tolerance <= 0.0) {
+            for (auto iter = std::next(route.stops.rbegin()); iter < route.stops.rend(); ++iter) {
+                data.points.push_back(stops_[*iter].point);
             }
-            if (coordinates.lng < min.lng) {
-                min.lng = coordinates.lng;
+        }
+        if (settings.simplify_tolerance > 0.0) {
+            data.weights = ComputeSimplificationWeights(data.points);
+        }
+        routes_.push_back(std::move(data));
+        segment_count += GetSegmentCount(routes_.back());
+
+        stops_[route.stops.front()].route_labels.push_back(route_id * 2);
+        if (route.route_type == domain::RouteType::LINEAR && route.stops.back() != route.stops.front()) {
+            stops_[route.stops.back()].route_labels.push_back(route_id * 2 + 1);
+        }
+    }
+
+    // удаление значка и подписей от точки остановки не зависит от масштаба тайла
+    stop_margin_ = settings.stop_radius;
+    for (const auto &stop : stops_) {
+        stop_margin_ = std::max(stop_margin_, GetReach({}, GetLabelBox({}, stop.name, settings.stop_label_font_size,
+                                                                       settings.stop_label_offset,
+                                                                       settings.underlayer_width)));
+        for (const auto label : stop.route_labels) {
+            stop_margin_ = std::max(stop_margin_, GetReach({}, GetLabelBox({}, routes_[label / 2].name,
+                                                                           settings.bus_label_font_size,
+                                                                           settings.bus_label_offset,
+                                                                           settings.underlayer_width)));
+        }
+    }
+
+    if (stops_.empty()) {
+        stop_cells_.resize(1);
+        segment_cells_.resize(1);
+        return;
+    }
+
+    // размер ячейки выбирается так, чтобы на ячейку приходилось около четырёх объектов
+    svg::Point grid_max = stops_.front().point;
+    grid_min_ = grid_max;
+    for (const auto &stop : stops_) {
+        grid_min_ = {std::min(grid_min_.x, stop.point.x), std::min(grid_min_.y, stop.point.y)};
+        grid_max = {std::max(grid_max.x, stop.point.x), std::max(grid_max.y, stop.point.y)};
+    }
+    const double width = grid_max.x - grid_min_.x;
+    const double height = grid_max.y - grid_min_.y;
+    const double cell_count = std::max(1.0, static_cast<double>(stops_.size() + segment_count) / 4.0);
+    cell_size_ = std::max(std::sqrt(width * height / cell_count), std::max(width, height) / MAX_GRID_SIDE);
+    if (IsZero(cell_size_)) {
+        cell_size_ = 1.0;
+    }
+    grid_width_ = static_cast<size_t>(width / cell_size_) + 1;
+    grid_height_ = static_cast<size_t>(height / cell_size_) + 1;
+    stop_cells_.resize(grid_width_ * grid_height_);
+    segment_cells_.resize(grid_width_ * grid_height_);
+
+    for (size_t i = 0; i < stops_.size(); ++i) {
+        const auto [from, to] = GetCellRange(stops_[i].point, stops_[i].point);
+        stop_cells_[from.second * grid_width_ + from.first].push_back(static_cast<uint32_t>(i));
+    }
+    for (size_t route = 0; route < routes_.size(); ++route) {
+        const auto &points = routes_[route].points;
+        for (size_t segment = 0; segment < GetSegmentCount(routes_[route]); ++segment) {
+            const auto &a = points[segment];
+            const auto &b = points[std::min(segment + 1, points.size() - 1)];
+            const auto [from, to] = GetCellRange({std::min(a.x, b.x), std::min(a.y, b.y)},
+                                                 {std::max(a.x, b.x), std::max(a.y, b.y)});
+            for (size_t y = from.second; y <= to.second; ++y) {
+                for (size_t x = from.first; x <= to.first; ++x) {
+                    segment_cells_[y * grid_width_ + x].push_back({static_cast<uint32_t>(route),
+                                                                   static_cast<uint32_t>(segment)});
+                }
             }
-            if (coordinates.lng > max.lng) {
-                max.lng = coordinates.lng;
+        }
+    }
+}
+
+svg::Document MapTileIndex::RenderTile(const Viewport &viewport) const {
+    const auto &settings = renderer_.settings_;
+    svg::Document doc;
+    if (settings.compact) {
+        renderer_.RenderCompactStyle(doc);
+    }
+
+    // масштаб, с которым область вписывается в размер карты
+    const double width = viewport.max.x - viewport.min.x;
+    const double height = viewport.max.y - viewport.min.y;
+    double scale = std::min(settings.size.x / width, settings.size.y / height);
+    if (!(scale > 0.0) || !std::isfinite(scale)) {
+        scale = 1.0;
+    }
+    auto project = [&viewport, scale](svg::Point point) {
+        return svg::Point{(point.x - viewport.min.x) * scale, (point.y - viewport.min.y) * scale};
+    };
+    // область в координатах тайла - [0, size.x] x [0, size.y]
+    const svg::Point size{width * scale, height * scale};
+    auto is_visible = [&size](svg::Point min, svg::Point max) {
+        return max.x >= 0.0 && max.y >= 0.0 && min.x <= size.x && min.y <= size.y;
+    };
+
+    // линии маршрутов: отрезки, попавшие в область с учётом толщины линии
+    const double line_margin = settings.line_width / 2 / scale;
+    const svg::Point line_min{viewport.min.x - line_margin, viewport.min.y - line_margin};
+    const svg::Point line_max{viewport.max.x + line_margin, viewport.max.y + line_margin};
+    std::vector<SegmentRef> segments;
+    const auto [line_from, line_to] = GetCellRange(line_min, line_max);
+    for (size_t y = line_from.second; y <= line_to.second; ++y) {
+        for (size_t x = line_from.first; x <= line_to.first; ++x) {
+            for (const auto &ref : segment_cells_[y * grid_width_ + x]) {
+                const auto &points = routes_[ref.route].points;
+                const auto &a = points[ref.segment];
+                const auto &b = points[std::min<size_t>(ref.segment + 1, points.size() - 1)];
+                if (std::max(a.x, b.x) >= line_min.x && std::max(a.y, b.y) >= line_min.y
+                        && std::min(a.x, b.x) <= line_max.x && std::min(a.y, b.y) <= line_max.y) {
+                    segments.push_back(ref);
+                }
             }
         }
     }
-    return std::pair<geo::Coordinates, geo::Coordinates>{min, max};
+    auto segment_less = [](const SegmentRef &lhs, const SegmentRef &rhs) {
+        return std::pair{lhs.route, lhs.segment} < std::pair{rhs.route, rhs.segment};
+    };
+    auto segment_equal = [](const SegmentRef &lhs, const SegmentRef &rhs) {
+        return lhs.route == rhs.route && lhs.segment == rhs.segment;
+    };
+    std::sort(segments.begin(), segments.end(), segment_less);
+    segments.erase(std::unique(segments.begin(), segments.end(), segment_equal), segments.end());
+
+    // подряд идущие отрезки одного маршрута рисуются одной ломаной
+    // допуск упрощения задан в пикселях вывода, поэтому на крупных масштабах вершин остаётся больше
+    const double tolerance = settings.simplify_tolerance / scale;
+    std::vector<svg::Point> points;
+    for (size_t begin = 0, end = 0; begin < segments.size(); begin = end) {
+        for (end = begin + 1; end < segments.size() && segments[end].route == segments[begin].route
+                && segments[end].segment == segments[end - 1].segment + 1; ++end) {
+        }
+        const auto &route = routes_[segments[begin].route];
+        size_t first = segments[begin].segment;
+        size_t last = std::min<size_t>(segments[end - 1].segment + 1, route.points.size() - 1);
+        points.clear();
+        if (settings.simplify_tolerance > 0.0) {
+            // участок расширяется до ближайших оставшихся вершин, чтобы оценка отклонения сохранялась
+            while (route.weights[first] <= tolerance) {
+                --first;
+            }
+            while (route.weights[last] <= tolerance) {
+                ++last;
+            }
+            for (size_t i = first; i <= last; ++i) {
+                if (route.weights[i] > tolerance) {
+                    points.push_back(project(route.points[i]));
+                }
+            }
+        } else {
+            for (size_t i = first; i <= last; ++i) {
+                points.push_back(project(route.points[i]));
+            }
+        }
+        renderer_.AddLine(doc, points, segments[begin].route);
+    }
+
+    // остановки, значок или подписи которых могут попасть в область
+    const double stop_margin = stop_margin_ / scale;
+    const svg::Point stop_min{viewport.min.x - stop_margin, viewport.min.y - stop_margin};
+    const svg::Point stop_max{viewport.max.x + stop_margin, viewport.max.y + stop_margin};
+    std::vector<uint32_t> stop_ids;
+    const auto [stop_from, stop_to] = GetCellRange(stop_min, stop_max);
+    for (size_t y = stop_from.second; y <= stop_to.second; ++y) {
+        for (size_t x = stop_from.first; x <= stop_to.first; ++x) {
+            for (const auto id : stop_cells_[y * grid_width_ + x]) {
+                const auto &point = stops_[id].point;
+                if (point.x >= stop_min.x && point.y >= stop_min.y && point.x <= stop_max.x && point.y <= stop_max.y) {
+                    stop_ids.push_back(id);
+                }
+            }
+        }
+    }
+    std::sort(stop_ids.begin(), stop_ids.end());
+
+    // названия маршрутов в порядке маршрутов
+    std::vector<std::pair<uint32_t, svg::Point>> route_labels;
+    for (const auto id : stop_ids) {
+        const auto point = project(stops_[id].point);
+        for (const auto label : stops_[id].route_labels) {
+            const auto box = GetLabelBox(point, routes_[label / 2].name, settings.bus_label_font_size,
+                                         settings.bus_label_offset, settings.underlayer_width);
+            if (is_visible(box.first, box.second)) {
+                route_labels.emplace_back(label, point);
+            }
+        }
+    }
+    std::sort(route_labels.begin(), route_labels.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.first < rhs.first;
+    });
+    for (const auto &[label, point] : route_labels) {
+        renderer_.AddRouteLabel(doc, routes_[label / 2].name, point, label / 2);
+    }
+
+    const double radius = settings.stop_radius;
+    for (const auto id : stop_ids) {
+        const auto point = project(stops_[id].point);
+        if (is_visible({point.x - radius, point.y - radius}, {point.x + radius, point.y + radius})) {
+            renderer_.AddStop(doc, point);
+        }
+    }
+    for (const auto id : stop_ids) {
+        const auto point = project(stops_[id].point);
+        const auto box = GetLabelBox(point, stops_[id].name, settings.stop_label_font_size,
+                                     settings.stop_label_offset, settings.underlayer_width);
+        if (is_visible(box.first, box.second)) {
+            renderer_.AddStopLabel(doc, stops_[id].name, point);
+        }
+    }
+    return doc;
+}
+
+size_t MapTileIndex::GetSegmentCount(const RouteData &route) const {
+    // маршрут из одной точки индексируется как вырожденный отрезок
+    return std::max<size_t>(route.points.size(), 2) - 1;
+}
+
+std::pair<std::pair<size_t, size_t>, std::pair<size_t, size_t>>
+MapTileIndex::GetCellRange(svg::Point min, svg::Point max) const {
+    auto to_cell = [this](double value, double origin, size_t count) {
+        const double cell = std::floor((value - origin) / cell_size_);
+        return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(count - 1)));
+    };
+    return {{to_cell(min.x, grid_min_.x, grid_width_), to_cell(min.y, grid_min_.y, grid_height_)},
+            {to_cell(max.x, grid_min_.x, grid_width_), to_cell(max.y, grid_min_.y, grid_height_)}};
+}
+
+// --------------------------- MapRenderCache --------------------------
+
+std::shared_ptr<const std::string> MapRenderCache::GetMap(const transport_catalogue::TransportCatalogue &catalogue,
+                                          const RenderSettings &settings,
+                                          const number_format::Settings &number_format) {
+    auto &entry = GetEntry(settings);
+    if (!entry.IsActual(catalogue, settings, number_format)) {
+        std::string map;
+        const auto &model = GetModel(catalogue, settings);
+        MapRenderer renderer;
+        renderer.SetSettings(settings);
+        if (settings.compression_level > 0) {
+            // части текста сжимаются по мере отрисовки, несжатая карта целиком не собирается
+            gzip::Writer writer(settings.compression_level);
+            renderer.RenderMap(model, [&writer](std::string_view chunk) {
+                writer.Write(chunk);
+            }, number_format, 1);
+            map = gzip::EncodeBase64(writer.Finish());
+        } else {
+            renderer.RenderMap(model, map, number_format);
+        }
+        Store(catalogue, settings, number_format, std::move(map));
+    } else if (!entry.map) {
+        entry.map = std::make_shared<const std::string>(entry.loader());
+        entry.loader = nullptr;
+    }
+    return entry.map;
+}
+
+std::string MapRenderCache::GetTile(const transport_catalogue::TransportCatalogue &catalogue,
+                                    const RenderSettings &settings,
+                                    const Viewport &viewport,
+                                    const number_format::Settings &number_format) {
+    const auto &model = GetModel(catalogue, settings);
+    if (!index_) {
+        index_.emplace(model, settings);
+    }
+    std::string tile;
+    index_->RenderTile(viewport).Render(tile, number_format);
+    return tile;
+}
+
+std::string MapRenderCache::GetRouteMap(const transport_catalogue::TransportCatalogue &catalogue,
+                                        const RenderSettings &settings,
+                                        const std::vector<RideSegment> &ride,
+                                        const number_format::Settings &number_format) {
+    // слой поездки дописывается к несжатой карте
+    RenderSettings plain_settings = settings;
+    plain_settings.compression_level = 0;
+    const auto map = GetMap(catalogue, plain_settings, number_format);
+    const auto &model = GetModel(catalogue, plain_settings);
+
+    MapRenderer renderer;
+    renderer.SetSettings(plain_settings);
+    svg::Document overlay;
+    renderer.RenderRideOverlay(overlay, model, ride);
+
+    // отрисованная сеть без закрывающего тега - неизменное начало документа
+    std::string_view prefix = *map;
+    if (const auto end = prefix.rfind("</svg>"sv); end != std::string_view::npos) {
+        prefix = prefix.substr(0, end);
+    }
+    std::string result;
+    result.reserve(prefix.size() + 64 * (ride.size() + 1));
+    result.append(prefix);
+    overlay.RenderObjects(result, number_format);
+    svg::Document::RenderEnd(result);
+    return result;
+}
+
+const RenderModel& MapRenderCache::GetModel(const transport_catalogue::TransportCatalogue &catalogue,
+                                            const RenderSettings &settings) {
+    // сжатие не влияет на модель
+    RenderSettings model_settings = settings;
+    model_settings.compression_level = 0;
+    if (!model_ || model_catalogue_ != &catalogue || model_version_ != catalogue.GetVersion()
+            || model_settings_ != model_settings) {
+        MapRenderer renderer;
+        renderer.SetSettings(settings);
+        model_ = renderer.BuildModel(catalogue);
+        model_catalogue_ = &catalogue;
+        model_version_ = catalogue.GetVersion();
+        model_settings_ = std::move(model_settings);
+        // индекс строится по модели и устаревает вместе с ней
+        index_.reset();
+    }
+    return *model_;
+}
+
+void MapRenderCache::Store(const transport_catalogue::TransportCatalogue &catalogue,
+                           const RenderSettings &settings,
+                           const number_format::Settings &number_format,
+                           std::string map) {
+    auto &entry = GetEntry(settings);
+    entry.catalogue = &catalogue;
+    entry.version = catalogue.GetVersion();
+    entry.settings = settings;
+    entry.number_format = number_format;
+    entry.map = std::make_shared<const std::string>(std::move(map));
+    entry.loader = nullptr;
+}
+
+void MapRenderCache::Store(const transport_catalogue::TransportCatalogue &catalogue,
+                           const RenderSettings &settings,
+                           const number_format::Settings &number_format,
+                           std::function<std::string()> loader) {
+    auto &entry = GetEntry(settings);
+    entry.catalogue = &catalogue;
+    entry.version = catalogue.GetVersion();
+    entry.settings = settings;
+    entry.number_format = number_format;
+    entry.map.reset();
+    entry.loader = std::move(loader);
+}
+
+MapRenderCache::MapEntry& MapRenderCache::GetEntry(const RenderSettings &settings) {
+    return settings.compression_level > 0 ? compressed_map_ : plain_map_;
+}
+
+bool MapRenderCache::MapEntry::IsActual(const transport_catalogue::TransportCatalogue &catalogue,
+                                        const RenderSettings &settings,
+                                        const number_format::Settings &number_format) const {
+    return (map || loader) && this->catalogue == &catalogue && version == catalogue.GetVersion()
+            && this->number_format == number_format && this->settings == settings;
 }
 
 } // namespace renderer
@@ -0,0 +1,64 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP
+#endif
+
+namespace mapped_file {
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::filesystem::path &path) {
+    std::shared_ptr<MappedFile> result(new MappedFile());
+#ifdef MAPPED_FILE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    result->size_ = static_cast<size_t>(file_stat.st_size);
+    if (result->size_ > 0) {
+        void *data = ::mmap(nullptr, result->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            result->data_ = static_cast<const char*>(data);
+            result->mapped_ = true;
+        }
+    }
+    ::close(fd);
+    if (result->mapped_ || result->size_ == 0) {
+        return result;
+    }
+#endif
+    // отображение недоступно - читаем файл целиком
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    result->buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    result->data_ = result->buffer_.data();
+    result->size_ = result->buffer_.size();
+    return result;
+}
+
+MappedFile::~MappedFile() {
+#ifdef MAPPED_FILE_MMAP
+    if (mapped_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+std::string_view MappedFile::GetData() const noexcept {
+    return {data_, size_};
+}
+
+} // namespace mapped_file
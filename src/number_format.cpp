@@ -0,0 +1,93 @@
+#include <charconv>
+#include <system_error>
+
+#include "number_format.h"
+
+namespace number_format {
+
+namespace {
+
+// отбрасывает незначащие нули дробной части ("1.500" -> "1.5", "2.000" -> "2")
+char* TrimFraction(char *first, char *last) {
+    char *dot = first;
+    while (dot != last && *dot != '.') {
+        ++dot;
+    }
+    if (dot == last) {
+        return last;
+    }
+    while (last != dot + 1 && *(last - 1) == '0') {
+        --last;
+    }
+    if (last == dot + 1) {
+        last = dot;
+    }
+    // "-0" после округления выводим как "0"
+    if (last - first == 2 && first[0] == '-' && first[1] == '0') {
+        first[0] = '0';
+        last = first + 1;
+    }
+    return last;
+}
+
+} // namespace
+
+char* Write(char *first, char *last, double value, const Settings &settings) {
+    std::to_chars_result result;
+    switch (settings.mode) {
+    case Mode::SHORTEST:
+        result = std::to_chars(first, last, value);
+        break;
+    case Mode::FIXED:
+        result = std::to_chars(first, last, value, std::chars_format::fixed, settings.precision);
+        if (result.ec == std::errc{}) {
+            return TrimFraction(first, result.ptr);
+        }
+        break;
+    default:
+        // совпадает с выводом std::ostream << double при точности по умолчанию
+        result = std::to_chars(first, last, value, std::chars_format::general, settings.precision);
+        break;
+    }
+    if (result.ec != std::errc{}) {
+        // не уместилось при заданной точности - выводим кратчайшее представление
+        result = std::to_chars(first, last, value);
+    }
+    return result.ec == std::errc{} ? result.ptr : first;
+}
+
+char* Write(char *first, char *last, int value) {
+    auto result = std::to_chars(first, last, value);
+    return result.ec == std::errc{} ? result.ptr : first;
+}
+
+void Print(std::ostream &out, double value, const Settings &settings) {
+    char buffer[BUFFER_SIZE];
+    const char *end = Write(buffer, buffer + BUFFER_SIZE, value, settings);
+    out.write(buffer, end - buffer);
+}
+
+void Print(std::ostream &out, int value) {
+    char buffer[BUFFER_SIZE];
+    const char *end = Write(buffer, buffer + BUFFER_SIZE, value);
+    out.write(buffer, end - buffer);
+}
+
+void Append(std::string &out, double value, const Settings &settings) {
+    char buffer[BUFFER_SIZE];
+    const char *end = Write(buffer, buffer + BUFFER_SIZE, value, settings);
+    out.append(buffer, static_cast<size_t>(end - buffer));
+}
+
+void Append(std::string &out, int value) {
+    char buffer[BUFFER_SIZE];
+    const char *end = Write(buffer, buffer + BUFFER_SIZE, value);
+    out.append(buffer, static_cast<size_t>(end - buffer));
+}
+
+std::ostream& operator<<(std::ostream &out, Formatted number) {
+    Print(out, number.value, number.settings);
+    return out;
+}
+
+} // namespace number_format
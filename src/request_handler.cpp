@@ -1,3 +1,5 @@
+#include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <memory>
 
@@ -51,6 +53,10 @@ void TransportCatalogueHandler::LoadDataFromJson(const json_reader::JsonIO &json
     routing_settings_ = json.LoadRoutingSettings();
 }
 
+void TransportCatalogueHandler::LoadRequestSettingsFromJson(const json_reader::JsonIO &json) {
+    serialize_settings_ = json.LoadSerializeSettings();
+}
+
 void TransportCatalogueHandler::LoadDataFronJson(const std::filesystem::__cxx11::path &file_path) {
     std::ifstream in(file_path);
     if (in.is_open()) {
@@ -65,7 +71,19 @@ void TransportCatalogueHandler::LoadRequestsAndAnswer(const json_reader::JsonIO
         std::cerr << "Can't init Transport Router"s << std::endl;
         return;
     }
-    json.AnswerRequests(catalogue_, render_settings_.value_or(renderer::RenderSettings{}), *router_, out);
+    json.AnswerRequests(catalogue_, render_settings_.value_or(renderer::RenderSettings{}), map_cache_, *router_, out);
+}
+
+void TransportCatalogueHandler::LoadRequestStreamAndAnswer(const json_reader::JsonIO &json,
+                                                           std::istream &in, std::ostream &out,
+                                                           size_t flush_batch, std::ostream &stats_out) {
+    if (!InitRouter()) {
+        std::cerr << "Can't init Transport Router"s << std::endl;
+        return;
+    }
+    const auto stats = json.AnswerRequestStream(catalogue_, render_settings_.value_or(renderer::RenderSettings{}),
+                                                map_cache_, *router_, in, out, flush_batch);
+    stats_out << stats << std::endl;
 }
 
 bool TransportCatalogueHandler::SerializeData() {
@@ -77,13 +95,56 @@ bool TransportCatalogueHandler::SerializeData() {
     serializator.AddTransportCatalogue(catalogue_);
     if (render_settings_) {
         serializator.AddRenderSettings(render_settings_.value());
+        if (serialize_settings_->prerender_map) {
+            serializator.AddRenderedMap(*map_cache_.GetMap(catalogue_, render_settings_.value()));
+        }
     }
     if (routing_settings_) {
         InitRouter();
-        router_->InitRouter();
+        // строится только то, что сохраняется в базе
+        switch (serialize_settings_->router_policy) {
+        case serialize::Serializator::Settings::RouterPolicy::FULL:
+            if (!serialize_settings_->checkpoint_file.empty()) {
+                SetRouterCheckpoints();
+            }
+            router_->InitRouter();
+            break;
+        case serialize::Serializator::Settings::RouterPolicy::GRAPH:
+            router_->InitGraph();
+            break;
+        case serialize::Serializator::Settings::RouterPolicy::NONE:
+            break;
+        }
         serializator.AddTransportRouter(*router_.get());
     }
-    return serializator.Serialize();
+    if (!serializator.Serialize()) {
+        return false;
+    }
+    // база записана - контрольная точка построения маршрутизатора больше не нужна
+    if (!serialize_settings_->checkpoint_file.empty()) {
+        std::error_code error;
+        std::filesystem::remove(serialize_settings_->checkpoint_file, error);
+    }
+    return true;
+}
+
+void TransportCatalogueHandler::SetRouterCheckpoints() {
+    const auto &settings = serialize_settings_.value();
+    transport_router::TransportRouter::Checkpoints checkpoints;
+    checkpoints.resume = [path = settings.checkpoint_file](const transport_router::TransportRouter::Graph &graph,
+                                                           transport_router::TransportRouter::Router &router) {
+        return serialize::Serializator::LoadRouterCheckpoint(path, graph, router);
+    };
+    checkpoints.save = [path = settings.checkpoint_file](const transport_router::TransportRouter::Graph &graph,
+                                                         const transport_router::TransportRouter::Router &router, size_t next_vertex) {
+        if (!serialize::Serializator::SaveRouterCheckpoint(path, graph, router, next_vertex)) {
+            std::cerr << "Can't save router checkpoint : "s << path.string() << std::endl;
+        }
+    };
+    checkpoints.interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(settings.checkpoint_interval));
+    checkpoints.max_overhead = settings.checkpoint_max_overhead;
+    router_->SetCheckpoints(std::move(checkpoints));
 }
 
 bool TransportCatalogueHandler::DeserializeData() {
@@ -92,15 +153,52 @@ bool TransportCatalogueHandler::DeserializeData() {
         return false;
     }
     serialize::Serializator serializator(serialize_settings_.value());
-    if (serializator.Deserialize(catalogue_, render_settings_, router_)) {
+    serialize::Serializator::MapLoader rendered_map;
+    if (serializator.Deserialize(catalogue_, render_settings_, router_, rendered_map)) {
         if (router_) {
             routing_settings_ = router_->GetSettings();
         }
+        // карта отрисована при формировании базы с форматом чисел по умолчанию
+        if (rendered_map && render_settings_) {
+            map_cache_.Store(catalogue_, render_settings_.value(), {}, std::move(rendered_map));
+        }
         return true;
     }
     return false;
 }
 
+bool TransportCatalogueHandler::SerializeDelta() {
+    if (!serialize_settings_) {
+        std::cerr << "Can't find Serialize Settings : "s << std::endl;
+        return false;
+    }
+    if (serialize_settings_->delta_file.empty()) {
+        std::cerr << "Can't find delta file in Serialize Settings"s << std::endl;
+        return false;
+    }
+    // загружаем базу, относительно которой формируется дельта
+    TransportCatalogue base;
+    std::optional<renderer::RenderSettings> base_render_settings;
+    std::unique_ptr<transport_router::TransportRouter> base_router;
+    serialize::Serializator::MapLoader base_map;
+    if (!serialize::Serializator(serialize_settings_.value()).Deserialize(base, base_render_settings,
+                                                                          base_router, base_map)) {
+        std::cerr << "Can't load base "s << serialize_settings_->path << std::endl;
+        return false;
+    }
+
+    serialize::Serializator serializator(serialize_settings_.value());
+    serializator.AddCatalogueDelta(base, catalogue_);
+    if (render_settings_ && render_settings_ != base_render_settings) {
+        serializator.AddRenderSettings(render_settings_.value());
+    }
+    if (routing_settings_ && (!base_router || base_router->GetSettings().wait_time != routing_settings_->wait_time
+                                     || base_router->GetSettings().velocity != routing_settings_->velocity)) {
+        serializator.AddRoutingSettings(routing_settings_.value());
+    }
+    return serializator.SerializeDelta();
+}
+
 bool TransportCatalogueHandler::ReInitRouter() {
     if (routing_settings_) {
         router_ = std::make_unique<transport_router::TransportRouter>(catalogue_, routing_settings_.value());
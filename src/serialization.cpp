@@ -1,9 +1,241 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <tuple>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/util/delimited_message_util.h>
 
 #include "serialization.h"
 
+#include "flat_base.h"
+#include "parallel.h"
+
 namespace serialize {
 
+namespace {
+
+// размер буфера файловых потоков protobuf (по умолчанию - 8 КБ)
+constexpr int IO_BUFFER_SIZE = 1 << 20;
+
+// сигнатура базы в потоковом формате: за ней следуют части базы с префиксом длины
+constexpr std::string_view STREAM_MAGIC{"TCSTREAM\x01", 9};
+// сигнатура файла дельты: за ней следует сообщение с изменениями базы
+constexpr std::string_view DELTA_MAGIC{"TCDELTA\x01", 8};
+// сигнатура файла контрольной точки таблицы маршрутизатора
+constexpr std::string_view CHECKPOINT_MAGIC{"TCCHKPT\x01", 8};
+// примерное число элементов (остановок, рёбер, ячеек таблицы и т.п.) в одной части потокового формата
+constexpr size_t CHUNK_ITEMS = 1 << 16;
+// отрисованная карта учитывается как один элемент на каждые CHUNK_BYTES_PER_ITEM байт
+constexpr size_t CHUNK_BYTES_PER_ITEM = 16;
+
+// множитель квантованных координат остановок (миллионные доли градуса)
+constexpr double COORDINATE_SCALE = 1e6;
+
+#ifdef _WIN32
+constexpr int BINARY_FLAG = O_BINARY;
+#else
+constexpr int BINARY_FLAG = 0;
+#endif
+
+// разделы маршрутизатора в базе плоского формата
+struct FlatRouterSections {
+    const flat::RoutingSettings *settings = nullptr;
+    const flat::RouterStop *router_stops = nullptr;
+    const flat::Edge *edges = nullptr;
+    const uint32_t *incidence = nullptr;
+    const uint32_t *offsets = nullptr;
+    const uint32_t *prev_edges = nullptr;
+    size_t router_stop_count = 0;
+    size_t edge_count = 0;
+    size_t incidence_count = 0;
+    size_t vertex_count = 0;
+
+    // находит разделы и проверяет согласованность их размеров (без чтения самих разделов);
+    // разделов графа (и таблицы) может не быть, если они не сохранялись в базе
+    static std::optional<FlatRouterSections> Read(const flat::Sections &sections) {
+        FlatRouterSections result;
+        size_t settings_count = 0, offset_count = 0, prev_edge_count = 0;
+        if (!sections.GetArray(flat::SectionType::ROUTING_SETTINGS, result.settings, settings_count)
+                || settings_count != 1) {
+            return std::nullopt;
+        }
+        if (!sections.Has(flat::SectionType::GRAPH_OFFSETS)) {
+            return result;
+        }
+        if (!sections.GetArray(flat::SectionType::ROUTER_STOPS, result.router_stops, result.router_stop_count)
+                || !sections.GetArray(flat::SectionType::GRAPH_EDGES, result.edges, result.edge_count)
+                || !sections.GetArray(flat::SectionType::GRAPH_INCIDENCE, result.incidence, result.incidence_count)
+                || !sections.GetArray(flat::SectionType::GRAPH_OFFSETS, result.offsets, offset_count)
+                || offset_count == 0) {
+            return std::nullopt;
+        }
+        result.vertex_count = offset_count - 1;
+        if (sections.Has(flat::SectionType::ROUTER_PREV_EDGES)
+                && (!sections.GetArray(flat::SectionType::ROUTER_PREV_EDGES, result.prev_edges, prev_edge_count)
+                    || prev_edge_count != result.vertex_count * result.vertex_count)) {
+            return std::nullopt;
+        }
+        if (result.offsets[result.vertex_count] != result.incidence_count
+                || !std::is_sorted(result.offsets, result.offsets + offset_count)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    // проверяет ссылки графа: номера вершин, рёбер, остановок и маршрутов; читает разделы графа,
+    // но не таблицу (её значения проверяются при построении маршрутов)
+    bool CheckGraph(size_t stop_count, size_t route_count) const {
+        for (size_t i = 0; i < router_stop_count; ++i) {
+            if (router_stops[i].vertex >= vertex_count || router_stops[i].stop >= stop_count) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < edge_count; ++i) {
+            if (edges[i].from >= vertex_count || edges[i].to >= vertex_count || edges[i].bus >= route_count) {
+                return false;
+            }
+        }
+        return std::all_of(incidence, incidence + incidence_count, [this](uint32_t edge_id) {
+            return edge_id < edge_count;
+        });
+    }
+
+    bool HasGraph() const {
+        return offsets != nullptr;
+    }
+};
+
+// возвращает номера остановок маршрута в любом из представлений (номерами или разностями номеров)
+std::vector<uint32_t> MakeRouteStopIds(const transport_catalogue_serialize::Route &p_route) {
+    if (p_route.stop_id_deltas_size() == 0) {
+        return {p_route.stop_ids().begin(), p_route.stop_ids().end()};
+    }
+    std::vector<uint32_t> result;
+    result.reserve(p_route.stop_id_deltas_size());
+    uint32_t id = 0;
+    for (const auto delta : p_route.stop_id_deltas()) {
+        id += static_cast<uint32_t>(delta);
+        result.push_back(id);
+    }
+    return result;
+}
+
+// перебирает расстояния, сгруппированные по остановкам отправления: func(stop_id_from, stop_id_to, distance)
+template <typename Func>
+void ForEachDistance(const google::protobuf::RepeatedPtrField<transport_catalogue_serialize::StopDistances> &p_groups,
+                     Func func) {
+    for (const auto &p_distances : p_groups) {
+        const int count = std::min(p_distances.stop_id_to_deltas_size(), p_distances.distances_size());
+        uint32_t stop_id_to = p_distances.stop_id_from();
+        for (int i = 0; i < count; ++i) {
+            stop_id_to += static_cast<uint32_t>(p_distances.stop_id_to_deltas(i));
+            func(p_distances.stop_id_from(), stop_id_to, p_distances.distances(i));
+        }
+    }
+}
+
+// перебирает расстояния каталога в обоих представлениях: func(stop_id_from, stop_id_to, distance)
+template <typename Func>
+void ForEachDistance(const transport_catalogue_serialize::Catalogue &p_catalogue, Func func) {
+    for (const auto &p_distance : p_catalogue.distances()) {
+        func(p_distance.stop_id_from(), p_distance.stop_id_to(), p_distance.distance());
+    }
+    ForEachDistance(p_catalogue.stop_distances(), func);
+}
+
+using RoutesInternalData = transport_router::TransportRouter::Router::RoutesInternalData;
+
+// дописывает строку таблицы маршрутизатора в упакованные массивы (место под строку зарезервировано)
+void PackRouterRow(const RoutesInternalData::value_type &row, graph_serialize::Router &p_router) {
+    auto p_total_time = p_router.mutable_total_time();
+    auto p_prev_edge = p_router.mutable_prev_edge();
+    for (const auto &internal : row) {
+        if (internal.has_value()) {
+            p_total_time->AddAlreadyReserved(internal->weight.total_time);
+            p_prev_edge->AddAlreadyReserved(internal->prev_edge ? static_cast<uint32_t>(*internal->prev_edge + 1) : 0);
+        } else {
+            p_total_time->AddAlreadyReserved(-1.0);
+            p_prev_edge->AddAlreadyReserved(0);
+        }
+    }
+}
+
+// заполняет строки [begin, end) таблицы из упакованной части таблицы, которая начинается со строки first_row
+void UnpackRouterRows(const graph_serialize::Router &p_router, size_t begin, size_t end,
+                      RoutesInternalData &routes_internal_data) {
+    const size_t vertex_count = std::min<size_t>(p_router.vertex_count(), routes_internal_data.size());
+    const size_t row_size = p_router.vertex_count();
+    const size_t first_row = p_router.first_row();
+    // если массивы короче таблицы, недостающие ячейки остаются недостижимыми
+    const size_t cell_count = std::min(p_router.total_time_size(), p_router.prev_edge_size());
+    const double *total_time = p_router.total_time().data();
+    const uint32_t *prev_edge = p_router.prev_edge().data();
+
+    for (size_t i = begin; i < std::min(end, vertex_count); ++i) {
+        auto &row = routes_internal_data[i];
+        for (size_t j = 0, cell = (i - first_row) * row_size; j < vertex_count && cell < cell_count; ++j, ++cell) {
+            if (total_time[cell] < 0) {
+                continue;
+            }
+            transport_router::TransportRouter::Router::RouteInternalData data;
+            data.weight.total_time = total_time[cell];
+            if (prev_edge[cell] != 0) {
+                data.prev_edge = prev_edge[cell] - 1;
+            }
+            row[j] = std::move(data);
+        }
+    }
+}
+
+// отпечаток графа (FNV-1a по вершинам и рёбрам) для проверки контрольных точек
+uint64_t HashGraph(const transport_router::TransportRouter::Graph &graph) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 1099511628211ull;
+        }
+    };
+    add(graph.GetVertexCount());
+    add(graph.GetEdgeCount());
+    for (const auto &edge : graph.GetEdges()) {
+        uint64_t total_time = 0;
+        std::memcpy(&total_time, &edge.weight.total_time, sizeof(total_time));
+        add(edge.from);
+        add(edge.to);
+        add(total_time);
+        add(static_cast<uint64_t>(edge.weight.span_count));
+    }
+    return hash;
+}
+
+// проверяет, что поток начинается с сигнатуры magic, и пропускает её
+bool SkipMagic(google::protobuf::io::ZeroCopyInputStream &input, std::string_view magic) {
+    const void *data = nullptr;
+    int size = 0;
+    if (!input.Next(&data, &size)) {
+        return false;
+    }
+    const std::string_view buffer(static_cast<const char*>(data), static_cast<size_t>(size));
+    if (buffer.substr(0, magic.size()) == magic) {
+        input.BackUp(size - static_cast<int>(magic.size()));
+        return true;
+    }
+    input.BackUp(size);
+    return false;
+}
+
+} // namespace
+
 void Serializator::AddTransportCatalogue(const TransportCatalogue &catalogue) {
     SaveStops(catalogue);
     SaveRoutes(catalogue);
@@ -15,99 +247,791 @@ void Serializator::AddRenderSettings(const renderer::RenderSettings &settings) {
 }
 
 void Serializator::AddTransportRouter(const transport_router::TransportRouter &router) {
-    SaveTransportRouter(router);
+    // настройки идут первыми: в потоковом формате по ним создаётся маршрутизатор при загрузке первой части
     SaveTransportRouterSettings(router.GetSettings());
+    if (settings_.router_policy == Settings::RouterPolicy::NONE) {
+        return;
+    }
+    SaveTransportRouter(router);
     SaveGraph(router.GetGraph());
-    SaveRouter(router.GetRouter());
+    if (settings_.router_policy == Settings::RouterPolicy::FULL) {
+        SaveRouter(router.GetRouter());
+    }
+}
+
+void Serializator::AddRenderedMap(const std::string &map) {
+    proto_catalogue_->set_rendered_map(map);
+    AddChunkItems(map.size() / CHUNK_BYTES_PER_ITEM);
+}
+
+void Serializator::AddRoutingSettings(const TransportRouter::RoutingSettings &settings) {
+    SaveTransportRouterSettings(settings);
+}
+
+void Serializator::AddCatalogueDelta(const TransportCatalogue &base, const TransportCatalogue &catalogue) {
+    auto p_delta = proto_catalogue_->mutable_delta();
+
+    // остановки, на которые ссылается дельта, нумеруются в порядке первого упоминания
+    std::unordered_map<std::string_view, int> stop_ids;
+    auto get_stop_id = [&stop_ids, p_delta](std::string_view name) {
+        const auto [it, inserted] = stop_ids.insert({name, static_cast<int>(stop_ids.size())});
+        if (inserted) {
+            p_delta->add_stop_names(std::string(name));
+        }
+        return it->second;
+    };
+
+    // добавленные и изменённые остановки; координаты сравниваются в том виде, в каком они попадут в файл
+    for (const auto &[name, stop] : catalogue.GetStops()) {
+        transport_catalogue_serialize::Stop p_stop;
+        p_stop.set_name(stop->name);
+        if (settings_.quantize_coordinates) {
+            p_stop.set_lat_e6(static_cast<int32_t>(std::llround(stop->coordinate.lat * COORDINATE_SCALE)));
+            p_stop.set_lng_e6(static_cast<int32_t>(std::llround(stop->coordinate.lng * COORDINATE_SCALE)));
+        } else {
+            *p_stop.mutable_coordinates() = MakeProtoCoordinates(stop->coordinate);
+        }
+        const auto base_stop = base.GetStops().find(name);
+        const auto coordinates = MakeStopCoordinates(p_stop);
+        if (base_stop == base.GetStops().end() || base_stop->second->coordinate.lat != coordinates.lat
+                || base_stop->second->coordinate.lng != coordinates.lng) {
+            *p_delta->add_stops() = std::move(p_stop);
+        }
+    }
+    for (const auto &[name, stop] : base.GetStops()) {
+        if (catalogue.GetStops().count(name) == 0) {
+            p_delta->add_removed_stops(stop->name);
+        }
+    }
+
+    // добавленные и изменённые маршруты
+    for (const auto &[name, route] : catalogue.GetRoutes()) {
+        const auto base_route = base.GetRoutes().find(name);
+        if (base_route != base.GetRoutes().end() && base_route->second->route_type == route->route_type
+                && std::equal(route->stops.begin(), route->stops.end(),
+                              base_route->second->stops.begin(), base_route->second->stops.end(),
+                              [](const domain::Stop *left, const domain::Stop *right) {
+                                  return left->name == right->name;
+                              })) {
+            continue;
+        }
+        auto p_route = p_delta->add_routes();
+        p_route->set_name(route->name);
+        p_route->set_type(MakeProtoRouteType(route->route_type));
+        int prev_id = 0;
+        for (auto stop : route->stops) {
+            const int id = get_stop_id(stop->name);
+            p_route->add_stop_id_deltas(id - prev_id);
+            prev_id = id;
+        }
+    }
+    for (const auto &[name, route] : base.GetRoutes()) {
+        if (catalogue.GetRoutes().count(name) == 0) {
+            p_delta->add_removed_routes(route->name);
+        }
+    }
+
+    // добавленные и изменённые расстояния группируются по остановкам отправления
+    std::vector<std::tuple<int, int, int>> distances;
+    for (const auto &[stop_from, stops] : catalogue.GetDistances()) {
+        const auto base_stops = base.GetDistances().find(stop_from);
+        for (const auto &[stop_to, distance] : stops) {
+            if (base_stops != base.GetDistances().end()) {
+                const auto base_distance = base_stops->second.find(stop_to);
+                if (base_distance != base_stops->second.end() && base_distance->second == distance) {
+                    continue;
+                }
+            }
+            distances.emplace_back(get_stop_id(stop_from), get_stop_id(stop_to), distance);
+        }
+    }
+    std::sort(distances.begin(), distances.end());
+    transport_catalogue_serialize::StopDistances *p_distances = nullptr;
+    int prev_id = 0;
+    for (const auto &[stop_id_from, stop_id_to, distance] : distances) {
+        if (!p_distances || p_distances->stop_id_from() != static_cast<uint32_t>(stop_id_from)) {
+            p_distances = p_delta->add_distances();
+            p_distances->set_stop_id_from(stop_id_from);
+            prev_id = stop_id_from;
+        }
+        p_distances->add_stop_id_to_deltas(stop_id_to - prev_id);
+        p_distances->add_distances(distance);
+        prev_id = stop_id_to;
+    }
+
+    // удалённые расстояния; расстояния удалённых остановок удаляются вместе с ними
+    for (const auto &[stop_from, stops] : base.GetDistances()) {
+        if (catalogue.GetStops().count(stop_from) == 0) {
+            continue;
+        }
+        const auto new_stops = catalogue.GetDistances().find(stop_from);
+        for (const auto &[stop_to, distance] : stops) {
+            if (catalogue.GetStops().count(stop_to) > 0
+                    && (new_stops == catalogue.GetDistances().end() || new_stops->second.count(stop_to) == 0)) {
+                auto p_distance = p_delta->add_removed_distances();
+                p_distance->set_stop_id_from(get_stop_id(stop_from));
+                p_distance->set_stop_id_to(get_stop_id(stop_to));
+            }
+        }
+    }
 }
 
 bool Serializator::Serialize() {
-    std::ofstream ofs(settings_.path, std::ios::binary);
-    if (!ofs.is_open ()) {
-            return false;
+    bool result = false;
+    if (settings_.format == Settings::Format::STREAM) {
+        // дописываем последнюю часть
+        FlushChunk();
+        result = stream_ && !stream_failed_;
+        if (stream_) {
+            // файл закрывается явно, чтобы узнать об ошибках записи
+            stream_->SetCloseOnDelete(false);
+            result = stream_->Close() && result;
+            stream_.reset();
+        }
+    } else if (settings_.format == Settings::Format::FLAT) {
+        std::ofstream ofs(settings_.path, std::ios::binary);
+        result = ofs.is_open() && SerializeFlat(ofs);
+    } else {
+        const int fd = ::open(settings_.path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | BINARY_FLAG, 0644);
+        if (fd >= 0) {
+            google::protobuf::io::FileOutputStream output(fd, IO_BUFFER_SIZE);
+            result = proto_catalogue_->SerializeToZeroCopyStream(&output);
+            result = output.Close() && result;
+        }
     }
-    proto_catalogue_.SerializeToOstream(&ofs);
     Clear();
-    return true;
+    return result;
+}
+
+bool Serializator::SerializeDelta() {
+    bool result = false;
+    const int fd = ::open(settings_.delta_file.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | BINARY_FLAG, 0644);
+    if (fd >= 0) {
+        google::protobuf::io::FileOutputStream output(fd, IO_BUFFER_SIZE);
+        {
+            google::protobuf::io::CodedOutputStream coded_output(&output);
+            coded_output.WriteRaw(DELTA_MAGIC.data(), static_cast<int>(DELTA_MAGIC.size()));
+        }
+        result = proto_catalogue_->SerializeToZeroCopyStream(&output);
+        result = output.Close() && result;
+    }
+    Clear();
+    return result;
 }
 
 bool Serializator::Deserialize(TransportCatalogue &catalogue,
                                std::optional<renderer::RenderSettings> &settings,
-                               std::unique_ptr<TransportRouter> &router) {
-    std::ifstream ifs(settings_.path, std::ios::binary);
-    if (!ifs.is_open() || !proto_catalogue_.ParseFromIstream(&ifs)) {
+                               std::unique_ptr<TransportRouter> &router,
+                               MapLoader &rendered_map) {
+    if (!DeserializeBase(catalogue, settings, router, rendered_map)) {
         return false;
     }
+    for (const auto &path : settings_.deltas) {
+        if (!ApplyDelta(path, catalogue, settings, router, rendered_map)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Serializator::ApplyDelta(const std::filesystem::path &path,
+                              TransportCatalogue &catalogue,
+                              std::optional<renderer::RenderSettings> &settings,
+                              std::unique_ptr<TransportRouter> &router,
+                              MapLoader &rendered_map) {
+    const int fd = ::open(path.string().c_str(), O_RDONLY | BINARY_FLAG);
+    if (fd < 0) {
+        return false;
+    }
+    {
+        google::protobuf::io::FileInputStream input(fd, IO_BUFFER_SIZE);
+        input.SetCloseOnDelete(true);
+        if (!IsDelta(input) || !proto_catalogue_->ParseFromZeroCopyStream(&input)) {
+            Clear();
+            return false;
+        }
+    }
+
+    const auto &p_delta = proto_catalogue_->delta();
+    auto get_stop_name = [&p_delta](uint32_t id) -> const std::string& {
+        if (id >= static_cast<uint32_t>(p_delta.stop_names_size())) {
+            throw std::out_of_range("Invalid stop id in delta");
+        }
+        return p_delta.stop_names(static_cast<int>(id));
+    };
 
-    LoadStops(catalogue);
-    LoadRoutes(catalogue);
-    LoadDistances(catalogue);
+    // маршруты удаляются раньше остановок, через которые они проходили
+    for (const auto &name : p_delta.removed_routes()) {
+        catalogue.RemoveRoute(name);
+    }
+    for (const auto &p_stop : p_delta.stops()) {
+        if (catalogue.GetStops().count(p_stop.name()) > 0) {
+            catalogue.SetStopCoordinates(p_stop.name(), MakeStopCoordinates(p_stop));
+        } else {
+            catalogue.AddStop(p_stop.name(), MakeStopCoordinates(p_stop));
+        }
+    }
+    for (const auto &p_distance : p_delta.removed_distances()) {
+        catalogue.RemoveDistance(get_stop_name(p_distance.stop_id_from()), get_stop_name(p_distance.stop_id_to()));
+    }
+    ForEachDistance(p_delta.distances(), [&](uint32_t stop_id_from, uint32_t stop_id_to, int distance) {
+        catalogue.SetDistance(get_stop_name(stop_id_from), get_stop_name(stop_id_to), distance);
+    });
+    for (const auto &p_route : p_delta.routes()) {
+        if (catalogue.GetRoutes().count(p_route.name()) > 0) {
+            catalogue.RemoveRoute(p_route.name());
+        }
+        std::vector<std::string> stops;
+        for (const auto stop_id : MakeRouteStopIds(p_route)) {
+            stops.push_back(get_stop_name(stop_id));
+        }
+        catalogue.AddRoute(p_route.name(), MakeRouteType(p_route.type()), stops);
+    }
+    for (const auto &name : p_delta.removed_stops()) {
+        catalogue.RemoveStop(name);
+    }
 
     LoadRenderSettings(settings);
 
-    LoadTransportRouter(catalogue, router);
+    // маршрутизатор, построенный по изменённым маршрутам, расстояниям или настройкам, строится заново
+    // по каталогу при первом запросе маршрута; добавленные и удалённые остановки без маршрутов его не меняют
+    const bool routing_changed = proto_catalogue_->has_router() || !p_delta.routes().empty()
+            || !p_delta.removed_routes().empty() || !p_delta.distances().empty()
+            || !p_delta.removed_distances().empty();
+    if (routing_changed && (router || proto_catalogue_->has_router())) {
+        TransportRouter::RoutingSettings routing_settings;
+        if (router) {
+            routing_settings = router->GetSettings();
+        }
+        if (proto_catalogue_->has_router()) {
+            LoadTransportRouterSettings(routing_settings);
+        }
+        router = std::make_unique<TransportRouter>(catalogue, routing_settings);
+    }
+
+    // карта зависит от остановок, маршрутов и настроек рендеринга
+    if (proto_catalogue_->has_render_settings() || !p_delta.stops().empty() || !p_delta.removed_stops().empty()
+            || !p_delta.routes().empty() || !p_delta.removed_routes().empty()) {
+        rendered_map = nullptr;
+    }
+
+    Clear();
+    return true;
+}
+
+bool Serializator::DeserializeBase(TransportCatalogue &catalogue,
+                                   std::optional<renderer::RenderSettings> &settings,
+                                   std::unique_ptr<TransportRouter> &router,
+                                   MapLoader &rendered_map) {
+    // база в плоском формате читается из отображённого в память файла
+    if (auto file = mapped_file::MappedFile::Open(settings_.path); file && flat::Sections::IsFlat(file->GetData())) {
+        const bool result = DeserializeFlat(file, catalogue, settings, router, rendered_map);
+        Clear();
+        return result;
+    }
+
+    const int fd = ::open(settings_.path.string().c_str(), O_RDONLY | BINARY_FLAG);
+    if (fd < 0) {
+        return false;
+    }
+    google::protobuf::io::FileInputStream input(fd, IO_BUFFER_SIZE);
+    input.SetCloseOnDelete(true);
+
+    if (IsStream(input)) {
+        // части загружаются и освобождаются по одной
+        while (true) {
+            bool clean_eof = false;
+            if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(proto_catalogue_, &input, &clean_eof)) {
+                if (!clean_eof) {
+                    return false;
+                }
+                break;
+            }
+            LoadChunk(catalogue, settings, router, rendered_map);
+            ResetChunk();
+        }
+    } else {
+        if (!proto_catalogue_->ParseFromZeroCopyStream(&input)) {
+            return false;
+        }
+        LoadChunk(catalogue, settings, router, rendered_map);
+    }
+
+    if (router) {
+        if (router->GetRouter()) {
+            // инициализируем маршрутизатор загруженными значениями
+            router->InternalInit();
+        } else if (router->GetGraph().GetVertexCount() > 0) {
+            // в базе сохранён только граф: таблица строится по нему при первом запросе маршрута
+            router->SetLoader([](TransportRouter &transport_router) {
+                transport_router.GetRouter() = std::make_unique<TransportRouter::Router>(transport_router.GetGraph());
+            });
+        }
+        // иначе граф и таблица строятся по каталогу при первом запросе маршрута
+    }
 
     Clear();
     return true;
 }
 
-void Serializator::Clear() noexcept {
-    proto_catalogue_.Clear();
+void Serializator::LoadChunk(TransportCatalogue &catalogue,
+                             std::optional<renderer::RenderSettings> &settings,
+                             std::unique_ptr<TransportRouter> &router,
+                             MapLoader &rendered_map) {
+    // таблица маршрутизатора не зависит от данных каталога: её строки разбираются частями
+    // на нескольких потоках одновременно с загрузкой каталога
+    const size_t table_parts = PrepareTransportRouter(catalogue, router);
+    parallel::For(table_parts + 1, [&](size_t task) {
+        if (task == 0) {
+            LoadStops(catalogue);
+            LoadRoutes(catalogue);
+            LoadDistances(catalogue);
+        } else {
+            LoadRouter(*router->GetRouter(), task - 1, table_parts);
+        }
+    });
+
+    LoadRenderSettings(settings);
+
+    // рёбрам графа нужны имена маршрутов, поэтому они загружаются после каталога
+    LoadTransportRouter(catalogue, router);
+
+    if (!proto_catalogue_->rendered_map().empty()) {
+        rendered_map = [map = std::move(*proto_catalogue_->mutable_rendered_map())]() {
+            return map;
+        };
+    }
+}
+
+bool Serializator::IsStream(google::protobuf::io::ZeroCopyInputStream &input) {
+    return SkipMagic(input, STREAM_MAGIC);
+}
+
+bool Serializator::IsDelta(google::protobuf::io::ZeroCopyInputStream &input) {
+    return SkipMagic(input, DELTA_MAGIC);
+}
+
+void Serializator::AddChunkItems(size_t count) {
+    if (settings_.format != Settings::Format::STREAM) {
+        return;
+    }
+    chunk_items_ += count;
+    if (chunk_items_ >= CHUNK_ITEMS) {
+        FlushChunk();
+    }
+}
+
+void Serializator::FlushChunk() {
+    if (!stream_ && !stream_failed_) {
+        const int fd = ::open(settings_.path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | BINARY_FLAG, 0644);
+        if (fd < 0) {
+            stream_failed_ = true;
+        } else {
+            stream_ = std::make_unique<google::protobuf::io::FileOutputStream>(fd, IO_BUFFER_SIZE);
+            stream_->SetCloseOnDelete(true);
+            google::protobuf::io::CodedOutputStream output(stream_.get());
+            output.WriteRaw(STREAM_MAGIC.data(), static_cast<int>(STREAM_MAGIC.size()));
+        }
+    }
+    if (stream_ && proto_catalogue_->ByteSizeLong() != 0
+            && !google::protobuf::util::SerializeDelimitedToZeroCopyStream(*proto_catalogue_, stream_.get())) {
+        stream_failed_ = true;
+    }
+    ResetChunk();
+}
+
+void Serializator::ResetChunk() {
+    // таблицы номеров остановок и маршрутов нужны следующим частям и не сбрасываются
+    arena_.Reset();
+    proto_catalogue_ = google::protobuf::Arena::CreateMessage<ProtoTransportCatalogue>(&arena_);
+    chunk_items_ = 0;
+}
+
+void Serializator::Clear() {
+    // память всех сообщений освобождается разом
+    ResetChunk();
     stop_name_by_id_.clear();
     stop_id_by_name_.clear();
     route_name_by_id_.clear();
     route_id_by_name_.clear();
 }
 
+bool Serializator::SerializeFlat(std::ostream &out) const {
+    flat::Writer writer;
+    const auto &p_catalogue = proto_catalogue_->catalogue();
+
+    std::string strings;
+    auto add_string = [&strings](const std::string &value) {
+        flat::StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size())};
+        strings += value;
+        return ref;
+    };
+
+    // остановки и маршруты записываются в порядке номеров
+    std::vector<flat::Stop> stops(p_catalogue.stops_size());
+    for (const auto &p_stop : p_catalogue.stops()) {
+        const auto coordinates = MakeStopCoordinates(p_stop);
+        stops.at(p_stop.id()) = {add_string(p_stop.name()), coordinates.lat, coordinates.lng};
+    }
+    std::vector<flat::Route> routes(p_catalogue.routes_size());
+    std::vector<uint32_t> route_stops;
+    for (const auto &p_route : p_catalogue.routes()) {
+        const auto stop_ids = MakeRouteStopIds(p_route);
+        routes.at(p_route.id()) = {add_string(p_route.name()), static_cast<uint32_t>(p_route.type()),
+                                   static_cast<uint32_t>(route_stops.size()),
+                                   static_cast<uint32_t>(stop_ids.size()), 0};
+        route_stops.insert(route_stops.end(), stop_ids.begin(), stop_ids.end());
+    }
+    std::vector<flat::Distance> distances;
+    ForEachDistance(p_catalogue, [&distances](uint32_t stop_id_from, uint32_t stop_id_to, int distance) {
+        distances.push_back({stop_id_from, stop_id_to, distance});
+    });
+    writer.AddSection(flat::SectionType::STRINGS, std::move(strings));
+    writer.AddArray(flat::SectionType::STOPS, stops);
+    writer.AddArray(flat::SectionType::ROUTES, routes);
+    writer.AddArray(flat::SectionType::ROUTE_STOPS, route_stops);
+    writer.AddArray(flat::SectionType::DISTANCES, distances);
+
+    // настройки рендеринга невелики и хранятся в виде сообщения protobuf
+    if (proto_catalogue_->has_render_settings()) {
+        writer.AddSection(flat::SectionType::RENDER_SETTINGS, proto_catalogue_->render_settings().SerializeAsString());
+    }
+
+    if (proto_catalogue_->has_router()) {
+        const auto &p_router = proto_catalogue_->router();
+        writer.AddArray(flat::SectionType::ROUTING_SETTINGS, std::vector<flat::RoutingSettings>{
+                {p_router.settings().wait_time(), 0, p_router.settings().velocity()}});
+    }
+
+    if (proto_catalogue_->has_router() && proto_catalogue_->router().has_graph()) {
+        const auto &p_router = proto_catalogue_->router();
+
+        std::vector<flat::RouterStop> router_stops;
+        router_stops.reserve(p_router.stop_by_id_size());
+        for (const auto &p_stop_by_id : p_router.stop_by_id()) {
+            router_stops.push_back({p_stop_by_id.id(), p_stop_by_id.stop_id()});
+        }
+        writer.AddArray(flat::SectionType::ROUTER_STOPS, router_stops);
+
+        const auto &p_graph = p_router.graph();
+        std::vector<flat::Edge> edges;
+        edges.reserve(p_graph.edges_size());
+        for (const auto &p_edge : p_graph.edges()) {
+            edges.push_back({p_edge.from(), p_edge.to(), p_edge.weight().bus_id(), p_edge.weight().span_count(),
+                             p_edge.weight().total_time()});
+        }
+        writer.AddArray(flat::SectionType::GRAPH_EDGES, edges);
+
+        std::vector<uint32_t> offsets{0};
+        std::vector<uint32_t> incidence;
+        offsets.reserve(p_graph.incidence_lists_size() + 1);
+        for (const auto &p_list : p_graph.incidence_lists()) {
+            incidence.insert(incidence.end(), p_list.edge_id().begin(), p_list.edge_id().end());
+            offsets.push_back(static_cast<uint32_t>(incidence.size()));
+        }
+        writer.AddArray(flat::SectionType::GRAPH_INCIDENCE, incidence);
+        writer.AddArray(flat::SectionType::GRAPH_OFFSETS, offsets);
+
+        // упакованная таблица маршрутизатора уже хранит последние рёбра в нужном виде
+        if (p_router.has_router()) {
+            const auto &prev_edge = p_router.router().prev_edge();
+            writer.AddSection(flat::SectionType::ROUTER_PREV_EDGES,
+                              std::string(reinterpret_cast<const char*>(prev_edge.data()),
+                                          prev_edge.size() * sizeof(uint32_t)));
+        }
+    }
+
+    if (!proto_catalogue_->rendered_map().empty()) {
+        writer.AddSection(flat::SectionType::RENDERED_MAP, proto_catalogue_->rendered_map());
+    }
+    return writer.Write(out);
+}
+
+bool Serializator::DeserializeFlat(const std::shared_ptr<const mapped_file::MappedFile> &file,
+                                   TransportCatalogue &catalogue,
+                                   std::optional<renderer::RenderSettings> &settings,
+                                   std::unique_ptr<TransportRouter> &router,
+                                   MapLoader &rendered_map) {
+    const auto sections = flat::Sections::Parse(file->GetData());
+    if (!sections) {
+        return false;
+    }
+    const auto strings = sections->GetBytes(flat::SectionType::STRINGS);
+    auto get_string = [strings](flat::StringRef ref) {
+        return strings.substr(ref.offset, ref.length);
+    };
+
+    // ссылки на строки и номера остановок проверяются до загрузки: повреждённая база отвергается целиком
+    const flat::Stop *stops = nullptr;
+    const flat::Route *routes = nullptr;
+    const uint32_t *route_stops = nullptr;
+    const flat::Distance *distances = nullptr;
+    size_t stop_count = 0, route_count = 0, route_stop_count = 0, distance_count = 0;
+    if (!sections->GetArray(flat::SectionType::STOPS, stops, stop_count)
+            || !sections->GetArray(flat::SectionType::ROUTES, routes, route_count)
+            || !sections->GetArray(flat::SectionType::ROUTE_STOPS, route_stops, route_stop_count)
+            || !sections->GetArray(flat::SectionType::DISTANCES, distances, distance_count)) {
+        return false;
+    }
+    for (size_t i = 0; i < stop_count; ++i) {
+        if (!flat::IsInside(stops[i].name, strings)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < route_count; ++i) {
+        const auto &route = routes[i];
+        if (!flat::IsInside(route.name, strings)
+                || route.first_stop > route_stop_count || route.stop_count > route_stop_count - route.first_stop) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < route_stop_count; ++i) {
+        if (route_stops[i] >= stop_count) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < distance_count; ++i) {
+        if (distances[i].stop_from >= stop_count || distances[i].stop_to >= stop_count) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < stop_count; ++i) {
+        const auto name = get_string(stops[i].name);
+        catalogue.AddStop(std::string(name), {stops[i].lat, stops[i].lng});
+        stop_name_by_id_.insert({static_cast<int>(i), name});
+    }
+    for (size_t i = 0; i < route_count; ++i) {
+        const auto &route = routes[i];
+        std::vector<std::string> stop_names;
+        stop_names.reserve(route.stop_count);
+        for (uint32_t j = 0; j < route.stop_count; ++j) {
+            stop_names.emplace_back(stop_name_by_id_.at(route_stops[route.first_stop + j]));
+        }
+        const auto name = get_string(route.name);
+        catalogue.AddRoute(std::string(name),
+                           MakeRouteType(static_cast<transport_catalogue_serialize::RouteType>(route.type)),
+                           stop_names);
+        route_name_by_id_.insert({static_cast<int>(i), name});
+    }
+    for (size_t i = 0; i < distance_count; ++i) {
+        catalogue.SetDistance(std::string(stop_name_by_id_.at(distances[i].stop_from)),
+                              std::string(stop_name_by_id_.at(distances[i].stop_to)),
+                              distances[i].distance);
+    }
+
+    if (sections->Has(flat::SectionType::RENDER_SETTINGS)) {
+        const auto bytes = sections->GetBytes(flat::SectionType::RENDER_SETTINGS);
+        if (!proto_catalogue_->mutable_render_settings()->ParseFromArray(bytes.data(), static_cast<int>(bytes.size()))) {
+            return false;
+        }
+        LoadRenderSettings(settings);
+    }
+
+    if (sections->Has(flat::SectionType::ROUTING_SETTINGS)) {
+        const auto router_sections = FlatRouterSections::Read(*sections);
+        if (!router_sections) {
+            return false;
+        }
+        // граф и таблица строятся при первом запросе маршрута; до этого из разделов маршрутизатора
+        // читаются только настройки и смещения списков рёбер вершин
+        const auto &routing_settings = *router_sections->settings;
+        router = std::make_unique<TransportRouter>(
+                catalogue, TransportRouter::RoutingSettings{routing_settings.wait_time, routing_settings.velocity});
+        // без графа в базе маршрутизатор строится по каталогу
+        if (router_sections->HasGraph()) {
+            router->SetLoader([file, &catalogue](TransportRouter &transport_router) {
+                LoadFlatRouter(file, catalogue, transport_router);
+            });
+        }
+    }
+
+    // отрисованная карта копируется из файла при первом запросе карты
+    if (const auto map = sections->GetBytes(flat::SectionType::RENDERED_MAP); !map.empty()) {
+        rendered_map = [file, map]() {
+            return std::string(map);
+        };
+    }
+    return true;
+}
+
+void Serializator::LoadFlatRouter(const std::shared_ptr<const mapped_file::MappedFile> &file,
+                                  const TransportCatalogue &catalogue,
+                                  TransportRouter &router) {
+    // размеры разделов и имена проверены при загрузке базы
+    const auto sections = flat::Sections::Parse(file->GetData());
+    const auto data = FlatRouterSections::Read(*sections);
+    const auto strings = sections->GetBytes(flat::SectionType::STRINGS);
+    const flat::Stop *stops = nullptr;
+    const flat::Route *routes = nullptr;
+    size_t stop_count = 0, route_count = 0;
+    sections->GetArray(flat::SectionType::STOPS, stops, stop_count);
+    sections->GetArray(flat::SectionType::ROUTES, routes, route_count);
+    // граф с неверными ссылками не используется: маршрутизатор строится по каталогу
+    if (!data->CheckGraph(stop_count, route_count)) {
+        router.InitGraph();
+        router.GetRouter() = std::make_unique<TransportRouter::Router>(router.GetGraph());
+        return;
+    }
+    auto get_name = [strings](const auto *records, uint32_t id) {
+        return strings.substr(records[id].name.offset, records[id].name.length);
+    };
+
+    for (size_t i = 0; i < data->router_stop_count; ++i) {
+        // остановки без маршрутов могли быть удалены дельтой
+        const auto found = catalogue.GetStops().find(get_name(stops, data->router_stops[i].stop));
+        if (found == catalogue.GetStops().end()) {
+            continue;
+        }
+        auto stop = found->second;
+        router.GetStopsById().insert({data->router_stops[i].vertex, stop});
+        router.GetIdsByStopName().insert({stop->name, data->router_stops[i].vertex});
+    }
+
+    auto &graph = router.GetGraph();
+    graph.GetEdges().reserve(data->edge_count);
+    for (size_t i = 0; i < data->edge_count; ++i) {
+        const auto &edge = data->edges[i];
+        transport_router::RouteWeight weight;
+        weight.bus_name = catalogue.GetRoutes().at(get_name(routes, edge.bus))->name;
+        weight.total_time = edge.total_time;
+        weight.span_count = static_cast<int>(edge.span_count);
+        graph.GetEdges().push_back({edge.from, edge.to, weight});
+    }
+    graph.GetIncidenceLists().reserve(data->vertex_count);
+    for (size_t i = 0; i < data->vertex_count; ++i) {
+        graph.GetIncidenceLists().emplace_back(data->incidence + data->offsets[i], data->incidence + data->offsets[i + 1]);
+    }
+
+    // маршрутизатор отвечает по таблице в отображённом файле и продлевает время жизни файла;
+    // если таблица не сохранялась, она строится по графу
+    if (data->prev_edges) {
+        router.GetRouter() = std::make_unique<TransportRouter::Router>(
+                graph, TransportRouter::Router::PrevEdgeTable{data->prev_edges, file});
+    } else {
+        router.GetRouter() = std::make_unique<TransportRouter::Router>(graph);
+    }
+}
+
 void Serializator::SaveStops(const TransportCatalogue &catalogue) {
     auto &stops = catalogue.GetStops();
+
+    // остановки нумеруются в порядке обхода маршрутов (маршруты - по возрастанию имён), остальные - по именам:
+    // соседние остановки маршрутов получают близкие номера, и разности номеров в маршрутах и расстояниях
+    // записываются короткими числами
+    std::vector<std::string_view> route_names;
+    route_names.reserve(catalogue.GetRoutes().size());
+    for (const auto &[name, route] : catalogue.GetRoutes()) {
+        route_names.push_back(name);
+    }
+    std::sort(route_names.begin(), route_names.end());
+    std::vector<const domain::Stop*> ordered_stops;
+    ordered_stops.reserve(stops.size());
+    for (const auto route_name : route_names) {
+        for (const auto stop : catalogue.GetRoutes().at(route_name)->stops) {
+            if (stop_id_by_name_.insert({stop->name, static_cast<int>(ordered_stops.size())}).second) {
+                ordered_stops.push_back(stop);
+            }
+        }
+    }
+    std::vector<const domain::Stop*> other_stops;
+    for (const auto &[name, stop] : stops) {
+        if (stop_id_by_name_.count(name) == 0) {
+            other_stops.push_back(stop);
+        }
+    }
+    std::sort(other_stops.begin(), other_stops.end(), [](const domain::Stop *left, const domain::Stop *right) {
+        return left->name < right->name;
+    });
+    for (const auto stop : other_stops) {
+        stop_id_by_name_.insert({stop->name, static_cast<int>(ordered_stops.size())});
+        ordered_stops.push_back(stop);
+    }
+
+    // сообщения создаются сразу в арене базы
+    auto p_catalogue = proto_catalogue_->mutable_catalogue();
+    p_catalogue->mutable_stops()->Reserve(static_cast<int>(stops.size()));
     uint32_t id = 0;
-    for (auto [name, stop] : stops) {
-        transport_catalogue_serialize::Stop p_stop;
-        p_stop.set_id(id);
-        p_stop.set_name(stop->name);
-        *p_stop.mutable_coordinates() = MakeProtoCoordinates(stop->coordinate);
-        stop_id_by_name_.insert({name, id++});
-        *proto_catalogue_.mutable_catalogue()->add_stops() = std::move(p_stop);
+    for (const auto stop : ordered_stops) {
+        auto p_stop = p_catalogue->add_stops();
+        p_stop->set_id(id++);
+        p_stop->set_name(stop->name);
+        if (settings_.quantize_coordinates) {
+            p_stop->set_lat_e6(static_cast<int32_t>(std::llround(stop->coordinate.lat * COORDINATE_SCALE)));
+            p_stop->set_lng_e6(static_cast<int32_t>(std::llround(stop->coordinate.lng * COORDINATE_SCALE)));
+        } else {
+            *p_stop->mutable_coordinates() = MakeProtoCoordinates(stop->coordinate);
+        }
+        AddChunkItems(1);
+        p_catalogue = proto_catalogue_->mutable_catalogue();
     }
 }
 
 void Serializator::SaveRoutes(const TransportCatalogue &catalogue) {
     auto &routes = catalogue.GetRoutes();
+    auto p_catalogue = proto_catalogue_->mutable_catalogue();
+    p_catalogue->mutable_routes()->Reserve(static_cast<int>(routes.size()));
     uint32_t id = 0;
     for (auto [name, route] : routes) {
-        transport_catalogue_serialize::Route p_route;
-        p_route.set_id(id);
-        p_route.set_name(route->name);
-        p_route.set_type(MakeProtoRouteType(route->route_type));
-        SaveRouteStops(*route, p_route);
+        auto p_route = p_catalogue->add_routes();
+        p_route->set_id(id);
+        p_route->set_name(route->name);
+        p_route->set_type(MakeProtoRouteType(route->route_type));
+        SaveRouteStops(*route, *p_route);
         route_id_by_name_.insert({name, id++});
-        *proto_catalogue_.mutable_catalogue()->add_routes() = std::move(p_route);
+        AddChunkItems(1 + route->stops.size());
+        p_catalogue = proto_catalogue_->mutable_catalogue();
     }
 }
 
 void Serializator::SaveRouteStops(const domain::Route &route,
                                   transport_catalogue_serialize::Route &p_route) {
+    p_route.mutable_stop_id_deltas()->Reserve(static_cast<int>(route.stops.size()));
+    int prev_id = 0;
     for (auto stop : route.stops) {
-        p_route.add_stop_ids(stop_id_by_name_.at(stop->name));
+        const int id = stop_id_by_name_.at(stop->name);
+        p_route.add_stop_id_deltas(id - prev_id);
+        prev_id = id;
     }
 }
 
 void Serializator::SaveDistances(const TransportCatalogue &catalogue) {
     auto &distances = catalogue.GetDistances();
+
+    // расстояния группируются по остановкам отправления и записываются по возрастанию номеров
+    std::vector<std::pair<int, const std::unordered_map<std::string_view, int>*>> sources;
+    sources.reserve(distances.size());
     for (auto &[stop1, stops] : distances) {
-        for(auto [stop2, distance] : stops) {
-            transport_catalogue_serialize::Distance p_distance;
-            p_distance.set_stop_id_from(stop_id_by_name_.at(stop1));
-            p_distance.set_stop_id_to(stop_id_by_name_.at(stop2));
-            p_distance.set_distance(distance);
-            *proto_catalogue_.mutable_catalogue()->add_distances() = std::move(p_distance);
+        sources.push_back({stop_id_by_name_.at(stop1), &stops});
+    }
+    std::sort(sources.begin(), sources.end());
+
+    auto p_catalogue = proto_catalogue_->mutable_catalogue();
+    std::vector<std::pair<int, int>> targets;
+    for (const auto &[stop_id_from, stops] : sources) {
+        targets.clear();
+        for (auto [stop2, distance] : *stops) {
+            targets.push_back({stop_id_by_name_.at(stop2), distance});
+        }
+        std::sort(targets.begin(), targets.end());
+
+        auto p_distances = p_catalogue->add_stop_distances();
+        p_distances->set_stop_id_from(stop_id_from);
+        p_distances->mutable_stop_id_to_deltas()->Reserve(static_cast<int>(targets.size()));
+        p_distances->mutable_distances()->Reserve(static_cast<int>(targets.size()));
+        int prev_id = stop_id_from;
+        for (const auto &[stop_id_to, distance] : targets) {
+            p_distances->add_stop_id_to_deltas(stop_id_to - prev_id);
+            p_distances->add_distances(distance);
+            prev_id = stop_id_to;
         }
+        AddChunkItems(targets.size());
+        p_catalogue = proto_catalogue_->mutable_catalogue();
     }
 }
 
 void Serializator::SaveRenderSettings(const renderer::RenderSettings &settings) {
-    auto p_settings = proto_catalogue_.mutable_render_settings();
+    auto p_settings = proto_catalogue_->mutable_render_settings();
 
     *p_settings->mutable_size() = MakeProtoPoint(settings.size);
 
@@ -128,34 +1052,47 @@ void Serializator::SaveRenderSettings(const renderer::RenderSettings &settings)
     for (auto &color : settings.color_palette) {
         *p_settings->add_color_palette() = MakeProtoColor(color);
     }
+
+    *p_settings->mutable_veil_color() = MakeProtoColor(settings.veil_color);
+
+    p_settings->set_compact(settings.compact);
+    p_settings->set_coordinate_precision(settings.coordinate_precision);
+    p_settings->set_simplify_tolerance(settings.simplify_tolerance);
+    p_settings->set_compression_level(settings.compression_level);
 }
 
 void Serializator::SaveTransportRouter(const TransportRouter &router) {
-    auto p_stops_by_id = proto_catalogue_.mutable_router()->mutable_stop_by_id();
+    auto p_stops_by_id = proto_catalogue_->mutable_router()->mutable_stop_by_id();
+    p_stops_by_id->Reserve(static_cast<int>(router.GetIdsByStopName().size()));
     for (auto [name, id] : router.GetIdsByStopName()) {
-        transport_router_serialize::StopById stop_by_id;
-        stop_by_id.set_id(id);
-        stop_by_id.set_stop_id(stop_id_by_name_.at(name));
-        *p_stops_by_id->Add() = std::move(stop_by_id);
+        auto p_stop_by_id = p_stops_by_id->Add();
+        p_stop_by_id->set_id(id);
+        p_stop_by_id->set_stop_id(stop_id_by_name_.at(name));
+        AddChunkItems(1);
+        p_stops_by_id = proto_catalogue_->mutable_router()->mutable_stop_by_id();
     }
 }
 
 void Serializator::SaveTransportRouterSettings(const TransportRouter::RoutingSettings &routing_settings) {
-    auto p_settings = proto_catalogue_.mutable_router()->mutable_settings();
+    auto p_settings = proto_catalogue_->mutable_router()->mutable_settings();
 
     p_settings->set_wait_time(routing_settings.wait_time);
     p_settings->set_velocity(routing_settings.velocity);
 }
 
 void Serializator::SaveGraph(const TransportRouter::Graph &graph) {
-    auto p_graph = proto_catalogue_.mutable_router()->mutable_graph();
+    auto p_graph = proto_catalogue_->mutable_router()->mutable_graph();
 
+    if (settings_.format != Settings::Format::STREAM) {
+        p_graph->mutable_edges()->Reserve(static_cast<int>(graph.GetEdgeCount()));
+    }
     for (auto &edge : graph.GetEdges()) {
-        graph_serialize::Edge p_edge;
-        p_edge.set_from(edge.from);
-        p_edge.set_to(edge.to);
-        *p_edge.mutable_weight() = MakeProtoWeight(edge.weight);
-        *p_graph->add_edges() = std::move(p_edge);
+        auto p_edge = p_graph->add_edges();
+        p_edge->set_from(edge.from);
+        p_edge->set_to(edge.to);
+        *p_edge->mutable_weight() = MakeProtoWeight(edge.weight);
+        AddChunkItems(1);
+        p_graph = proto_catalogue_->mutable_router()->mutable_graph();
     }
 
     for (auto &list : graph.GetIncidenceLists()) {
@@ -163,79 +1100,87 @@ void Serializator::SaveGraph(const TransportRouter::Graph &graph) {
         for (auto id : list) {
             p_list->add_edge_id(id);
         }
+        AddChunkItems(1 + list.size());
+        p_graph = proto_catalogue_->mutable_router()->mutable_graph();
     }
 
 }
 
 void Serializator::SaveRouter(const std::unique_ptr<TransportRouter::Router> &router) {
-    auto p_router = proto_catalogue_.mutable_router()->mutable_router();
-
-    for (const auto &data : router->GetRoutesInternalData()) {
-        graph_serialize::RoutesInternalData p_data;
-        for (const auto &internal : data) {
-            graph_serialize::OptionalRouteInternalData p_internal;
-            if (internal.has_value()) {
-                auto &value = internal.value();
-                auto p_value = p_internal.mutable_route_internal_data();
-                p_value->set_total_time(value.weight.total_time);
-                if (value.prev_edge.has_value()) {
-                    p_value->set_prev_edge(value.prev_edge.value());
-                }
-            }
-            *p_data.add_routes_internal_data() = std::move(p_internal);
+    const auto &routes_internal_data = router->GetRoutesInternalData();
+    const size_t vertex_count = routes_internal_data.size();
+    // в потоковом формате каждая часть начинается с целой строки таблицы
+    const size_t chunk_rows = settings_.format == Settings::Format::STREAM
+            ? std::max<size_t>(1, CHUNK_ITEMS / std::max<size_t>(1, vertex_count))
+            : vertex_count;
+
+    graph_serialize::Router *p_router = nullptr;
+    for (size_t i = 0; i < vertex_count; ++i) {
+        if (i % chunk_rows == 0) {
+            p_router = proto_catalogue_->mutable_router()->mutable_router();
+            p_router->set_vertex_count(static_cast<uint32_t>(vertex_count));
+            p_router->set_first_row(static_cast<uint32_t>(i));
+            const size_t cell_count = std::min(chunk_rows, vertex_count - i) * vertex_count;
+            p_router->mutable_total_time()->Reserve(static_cast<int>(cell_count));
+            p_router->mutable_prev_edge()->Reserve(static_cast<int>(cell_count));
+        }
+        PackRouterRow(routes_internal_data[i], *p_router);
+        if ((i + 1) % chunk_rows == 0) {
+            AddChunkItems(CHUNK_ITEMS);
         }
-        *p_router->add_routes_internal_data() = std::move(p_data);
+    }
+    if (vertex_count == 0) {
+        proto_catalogue_->mutable_router()->mutable_router()->set_vertex_count(0);
     }
 }
 
 void Serializator::LoadStops(TransportCatalogue &catalogue) {
-    auto stops_count = proto_catalogue_.catalogue().stops_size();
+    auto stops_count = proto_catalogue_->catalogue().stops_size();
     for (int i = 0; i < stops_count; ++i) {
-        auto &p_stop = proto_catalogue_.catalogue().stops(i);
-        catalogue.AddStop(p_stop.name(), MakeCoordinates(p_stop.coordinates()));
-        stop_name_by_id_.insert({p_stop.id(), p_stop.name()});
+        auto &p_stop = proto_catalogue_->catalogue().stops(i);
+        catalogue.AddStop(p_stop.name(), MakeStopCoordinates(p_stop));
+        // имена берутся из каталога: сообщения освобождаются раньше, чем заканчивается загрузка
+        stop_name_by_id_.insert({p_stop.id(), catalogue.GetStops().at(p_stop.name())->name});
     }
 }
 
 void Serializator::LoadRoutes(TransportCatalogue &catalogue) {
-    auto routes_count = proto_catalogue_.catalogue().routes_size();
+    auto routes_count = proto_catalogue_->catalogue().routes_size();
     for (int i = 0; i < routes_count; ++i) {
-        auto &p_route = proto_catalogue_.catalogue().routes(i);
+        auto &p_route = proto_catalogue_->catalogue().routes(i);
         LoadRoute(catalogue, p_route);
-        route_name_by_id_.insert({p_route.id(), p_route.name()});
+        route_name_by_id_.insert({p_route.id(), catalogue.GetRoutes().at(p_route.name())->name});
     }
 }
 
 void Serializator::LoadRoute(TransportCatalogue &catalogue,
                              const transport_catalogue_serialize::Route &p_route) const {
-    auto stops_count = p_route.stop_ids_size();
+    const auto stop_ids = MakeRouteStopIds(p_route);
     std::vector<std::string> stops;
-    stops.reserve(stops_count);
-    for(int i = 0; i < stops_count; ++i) {
-        auto stop_name = stop_name_by_id_.at(p_route.stop_ids(i));
+    stops.reserve(stop_ids.size());
+    for (const auto stop_id : stop_ids) {
+        auto stop_name = stop_name_by_id_.at(stop_id);
         stops.push_back(std::string(stop_name));
     }
     catalogue.AddRoute(p_route.name(), MakeRouteType(p_route.type()), stops);
 }
 
 void Serializator::LoadDistances(TransportCatalogue &catalogue) const {
-    auto distances_count = proto_catalogue_.catalogue().distances_size();
-    for (int i = 0; i < distances_count; ++i) {
-        auto &p_distance = proto_catalogue_.catalogue().distances(i);
-        auto stop_from = std::string(stop_name_by_id_.at(p_distance.stop_id_from()));
-        auto stop_to = std::string(stop_name_by_id_.at(p_distance.stop_id_to()));
-        catalogue.SetDistance(stop_from, stop_to, p_distance.distance());
-    }
+    ForEachDistance(proto_catalogue_->catalogue(), [&](uint32_t stop_id_from, uint32_t stop_id_to, int distance) {
+        auto stop_from = std::string(stop_name_by_id_.at(stop_id_from));
+        auto stop_to = std::string(stop_name_by_id_.at(stop_id_to));
+        catalogue.SetDistance(stop_from, stop_to, distance);
+    });
 }
 
 void Serializator::LoadRenderSettings(std::optional<renderer::RenderSettings> &result_settings) const {
 
     // если данные о настройках не сериализованы - ничего не пишем
-    if (!proto_catalogue_.has_render_settings()) {
+    if (!proto_catalogue_->has_render_settings()) {
         return;
     }
 
-    auto &p_settings = proto_catalogue_.render_settings();
+    auto &p_settings = proto_catalogue_->render_settings();
 
     renderer::RenderSettings settings;
 
@@ -262,25 +1207,64 @@ void Serializator::LoadRenderSettings(std::optional<renderer::RenderSettings> &r
         settings.color_palette.push_back(MakeColor(p_settings.color_palette(i)));
     }
 
+    if (p_settings.has_veil_color()) {
+        settings.veil_color = MakeColor(p_settings.veil_color());
+    }
+
+    settings.compact = p_settings.compact();
+    // в старых базах точности нет - остаётся значение по умолчанию
+    if (p_settings.has_coordinate_precision()) {
+        settings.coordinate_precision = p_settings.coordinate_precision();
+    }
+    settings.simplify_tolerance = p_settings.simplify_tolerance();
+    settings.compression_level = p_settings.compression_level();
+
     result_settings = settings;
 }
 
+size_t Serializator::PrepareTransportRouter(const TransportCatalogue &catalogue,
+                                           std::unique_ptr<TransportRouter> &transport_router) {
+    // если данные о роутере не сериализованы, нчиего не пишем
+    if (!proto_catalogue_->has_router()) {
+        return 0;
+    }
+
+    // в потоковом формате данные маршрутизатора приходят несколькими частями,
+    // маршрутизатор создаётся по настройкам из первой из них
+    if (!transport_router) {
+        TransportRouter::RoutingSettings routing_settings;
+        LoadTransportRouterSettings(routing_settings);
+        transport_router = std::make_unique<TransportRouter>(catalogue, routing_settings);
+    }
+
+    // списки рёбер вершин задают размер таблицы и не зависят от каталога
+    LoadIncidenceLists(transport_router->GetGraph());
+
+    // таблица идёт после графа: маршрутизатор создаётся, когда граф загружен полностью
+    const auto &p_table = proto_catalogue_->router().router();
+    if (!proto_catalogue_->router().has_router()) {
+        return 0;
+    }
+    if (!transport_router->GetRouter()) {
+        transport_router->GetRouter() =
+                std::make_unique<TransportRouter::Router>(transport_router->GetGraph(), false);
+    }
+    if (p_table.routes_internal_data_size() != 0) {
+        return 1;
+    }
+    const size_t row_size = std::max<size_t>(1, p_table.vertex_count());
+    const size_t row_count = static_cast<size_t>(p_table.total_time_size()) / row_size;
+    return std::clamp<size_t>(row_count, 1, parallel::GetThreadCount() * 4);
+}
+
 void Serializator::LoadTransportRouter(const TransportCatalogue &catalogue,
                                        std::unique_ptr<TransportRouter> &transport_router) {
-
-    // если данные о роутере не сериализованы, нчиего не пишем
-    if (!proto_catalogue_.has_router()) {
+    if (!proto_catalogue_->has_router()) {
         return;
     }
 
-    // загружаем настройки
-    TransportRouter::RoutingSettings routing_settings;
-    LoadTransportRouterSettings(routing_settings);
-    // создаём пустой транспортный маршрутизатор
-    transport_router = std::make_unique<TransportRouter>(catalogue, routing_settings);
-
     // загружаем данные об используемых остановках
-    auto &p_router = proto_catalogue_.router();
+    auto &p_router = proto_catalogue_->router();
     auto stops_count = p_router.stop_by_id_size();
     for (auto i = 0; i < stops_count; ++i) {
         auto &p_stop_by_id = p_router.stop_by_id(i);
@@ -289,52 +1273,153 @@ void Serializator::LoadTransportRouter(const TransportCatalogue &catalogue,
         transport_router->GetIdsByStopName().insert({stop->name, p_stop_by_id.id()});
     }
 
-    // загружаем граф
-    LoadGraph(catalogue, transport_router->GetGraph());
-    // создаём роутер и загружаем внуттреннее состояние
-    transport_router->GetRouter() =
-            std::make_unique<TransportRouter::Router>(transport_router->GetGraph(), false);
-    LoadRouter(catalogue, transport_router->GetRouter());
-    // инициализируем маршрутизатор загруженными значениями
-    transport_router->InternalInit();
+    // загружаем рёбра графа (дописываются к уже загруженным)
+    LoadGraphEdges(catalogue, transport_router->GetGraph());
 }
 
 void Serializator::LoadTransportRouterSettings(TransportRouter::RoutingSettings &routing_settings) const {
-    auto &p_settings = proto_catalogue_.router().settings();
+    auto &p_settings = proto_catalogue_->router().settings();
 
     routing_settings.wait_time = p_settings.wait_time();
     routing_settings.velocity = p_settings.velocity();
 }
 
-void Serializator::LoadGraph(const TransportCatalogue &catalogue, TransportRouter::Graph &graph) {
-    auto &p_graph = proto_catalogue_.router().graph();
-    auto edge_count = p_graph.edges_size();
-
-    for (auto i = 0; i < edge_count; ++i) {
-        graph::Edge<transport_router::RouteWeight> edge;
-        auto &p_edge = p_graph.edges(i);
-        edge.from = p_edge.from();
-        edge.to = p_edge.to();
-        edge.weight = MakeWeight(catalogue, p_edge.weight());
-        graph.GetEdges().push_back(std::move(edge));
-    }
+void Serializator::LoadGraphEdges(const TransportCatalogue &catalogue, TransportRouter::Graph &graph) const {
+    auto &p_graph = proto_catalogue_->router().graph();
+    auto &edges = graph.GetEdges();
+    const size_t first_edge = edges.size();
+    const size_t edge_count = static_cast<size_t>(p_graph.edges_size());
+    edges.resize(first_edge + edge_count);
+
+    // рёбра независимы и разбираются частями на нескольких потоках
+    constexpr size_t PART_SIZE = 4096;
+    parallel::For((edge_count + PART_SIZE - 1) / PART_SIZE, [&](size_t part) {
+        const size_t end = std::min(edge_count, (part + 1) * PART_SIZE);
+        for (size_t i = part * PART_SIZE; i < end; ++i) {
+            auto &p_edge = p_graph.edges(static_cast<int>(i));
+            auto &edge = edges[first_edge + i];
+            edge.from = p_edge.from();
+            edge.to = p_edge.to();
+            edge.weight = MakeWeight(catalogue, p_edge.weight());
+        }
+    });
+}
 
+void Serializator::LoadIncidenceLists(TransportRouter::Graph &graph) const {
+    auto &p_graph = proto_catalogue_->router().graph();
     auto incidence_lists_count = p_graph.incidence_lists_size();
     for (auto i = 0; i < incidence_lists_count; ++i) {
-        TransportRouter::Graph::IncidenceList list;
         auto &p_list = p_graph.incidence_lists(i);
-        auto list_count = p_list.edge_id_size();
-        for (auto j = 0; j < list_count; ++j) {
-            list.push_back(p_list.edge_id(j));
+        graph.GetIncidenceLists().emplace_back(p_list.edge_id().begin(), p_list.edge_id().end());
+    }
+}
+
+void Serializator::LoadRouter(TransportRouter::Router &router, size_t part, size_t part_count) const {
+    auto &p_router = proto_catalogue_->router().router();
+    if (p_router.routes_internal_data_size() != 0) {
+        LoadLegacyRouter(router);
+        return;
+    }
+
+    // строки части part из part_count частей строк этой порции таблицы
+    const size_t row_size = p_router.vertex_count();
+    const size_t cell_count = std::min(p_router.total_time_size(), p_router.prev_edge_size());
+    const size_t row_count = row_size == 0 ? 0 : cell_count / row_size;
+    const size_t first_row = p_router.first_row();
+    UnpackRouterRows(p_router, first_row + row_count * part / part_count,
+                     first_row + row_count * (part + 1) / part_count, router.GetRoutesInternalData());
+}
+
+bool Serializator::SaveRouterCheckpoint(const std::filesystem::path &path, const TransportRouter::Graph &graph,
+                                        const TransportRouter::Router &router, size_t next_vertex) {
+    // контрольная точка пишется во временный файл, чтобы сбой во время записи не испортил предыдущую
+    auto temp_path = path;
+    temp_path += ".tmp";
+    const int fd = ::open(temp_path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | BINARY_FLAG, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const auto &routes_internal_data = router.GetRoutesInternalData();
+    const size_t vertex_count = routes_internal_data.size();
+
+    google::protobuf::io::FileOutputStream output(fd, IO_BUFFER_SIZE);
+    {
+        google::protobuf::io::CodedOutputStream coded_output(&output);
+        coded_output.WriteRaw(CHECKPOINT_MAGIC.data(), static_cast<int>(CHECKPOINT_MAGIC.size()));
+    }
+    graph_serialize::RouterCheckpoint header;
+    header.set_next_vertex(static_cast<uint32_t>(next_vertex));
+    header.set_vertex_count(static_cast<uint32_t>(vertex_count));
+    header.set_graph_hash(HashGraph(graph));
+    bool result = google::protobuf::util::SerializeDelimitedToZeroCopyStream(header, &output);
+
+    // таблица пишется частями, как в потоковом формате: в памяти не собирается её полная копия
+    const size_t chunk_rows = std::max<size_t>(1, CHUNK_ITEMS / std::max<size_t>(1, vertex_count));
+    graph_serialize::Router p_router;
+    for (size_t first_row = 0; result && first_row < vertex_count; first_row += chunk_rows) {
+        const size_t last_row = std::min(vertex_count, first_row + chunk_rows);
+        p_router.Clear();
+        p_router.set_vertex_count(static_cast<uint32_t>(vertex_count));
+        p_router.set_first_row(static_cast<uint32_t>(first_row));
+        p_router.mutable_total_time()->Reserve(static_cast<int>((last_row - first_row) * vertex_count));
+        p_router.mutable_prev_edge()->Reserve(static_cast<int>((last_row - first_row) * vertex_count));
+        for (size_t i = first_row; i < last_row; ++i) {
+            PackRouterRow(routes_internal_data[i], p_router);
         }
-        graph.GetIncidenceLists().push_back(list);
+        result = google::protobuf::util::SerializeDelimitedToZeroCopyStream(p_router, &output);
+    }
+    result = output.Close() && result;
+
+    std::error_code error;
+    if (result) {
+        std::filesystem::rename(temp_path, path, error);
     }
+    return result && !error;
 }
 
-void Serializator::LoadRouter(const TransportCatalogue &catalogue,
-                              std::unique_ptr<TransportRouter::Router> &router) {
-    auto &p_router = proto_catalogue_.router().router();
-    auto &routes_internal_data = router->GetRoutesInternalData();
+size_t Serializator::LoadRouterCheckpoint(const std::filesystem::path &path, const TransportRouter::Graph &graph,
+                                          TransportRouter::Router &router) {
+    const int fd = ::open(path.string().c_str(), O_RDONLY | BINARY_FLAG);
+    if (fd < 0) {
+        return 0;
+    }
+    google::protobuf::io::FileInputStream input(fd, IO_BUFFER_SIZE);
+    input.SetCloseOnDelete(true);
+
+    auto &routes_internal_data = router.GetRoutesInternalData();
+    const size_t vertex_count = routes_internal_data.size();
+    graph_serialize::RouterCheckpoint header;
+    if (!SkipMagic(input, CHECKPOINT_MAGIC)
+            || !google::protobuf::util::ParseDelimitedFromZeroCopyStream(&header, &input, nullptr)
+            || header.vertex_count() != vertex_count || header.next_vertex() > vertex_count
+            || header.graph_hash() != HashGraph(graph)) {
+        return 0;
+    }
+
+    // контрольная точка годится, только если в ней все строки таблицы
+    size_t row_count = 0;
+    graph_serialize::Router p_router;
+    bool clean_eof = false;
+    while (google::protobuf::util::ParseDelimitedFromZeroCopyStream(&p_router, &input, &clean_eof)) {
+        const size_t rows = vertex_count == 0
+                ? 0 : std::min(p_router.total_time_size(), p_router.prev_edge_size()) / vertex_count;
+        if (p_router.vertex_count() != vertex_count || p_router.first_row() != row_count) {
+            return 0;
+        }
+        UnpackRouterRows(p_router, row_count, row_count + rows, routes_internal_data);
+        row_count += rows;
+        // разбор сообщения с префиксом длины дописывает поля к уже разобранным
+        p_router.Clear();
+    }
+    if (!clean_eof || row_count != vertex_count) {
+        return 0;
+    }
+    return header.next_vertex();
+}
+
+void Serializator::LoadLegacyRouter(TransportRouter::Router &router) const {
+    auto &p_router = proto_catalogue_->router().router();
+    auto &routes_internal_data = router.GetRoutesInternalData();
 
     auto routes_internal_data_count = p_router.routes_internal_data_size();
 
@@ -378,6 +1463,13 @@ Serializator::MakeCoordinates(const transport_catalogue_serialize::Coordinates &
     return coordinates;
 }
 
+geo::Coordinates Serializator::MakeStopCoordinates(const transport_catalogue_serialize::Stop &p_stop) {
+    if (p_stop.has_coordinates()) {
+        return MakeCoordinates(p_stop.coordinates());
+    }
+    return {p_stop.lat_e6() / COORDINATE_SCALE, p_stop.lng_e6() / COORDINATE_SCALE};
+}
+
 transport_catalogue_serialize::RouteType
 Serializator::MakeProtoRouteType(domain::RouteType route_type) {
     using ProtoRouteType = transport_catalogue_serialize::RouteType;
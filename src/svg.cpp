@@ -1,4 +1,4 @@
-#include <unordered_map>
+#include <array>
 
 #include "svg.h"
 
@@ -6,6 +6,39 @@ namespace svg {
 
 using namespace std::literals;
 
+namespace {
+
+// таблица замен для служебных символов XML (пустая строка - символ не экранируется)
+constexpr std::array<std::string_view, 256> MakeEscapeTable() {
+    std::array<std::string_view, 256> table{};
+    table[static_cast<unsigned char>('"')] = "&quot;"sv;
+    table[static_cast<unsigned char>('&')] = "&amp;"sv;
+    table[static_cast<unsigned char>('\'')] = "&apos;"sv;
+    table[static_cast<unsigned char>('<')] = "&lt;"sv;
+    table[static_cast<unsigned char>('>')] = "&gt;"sv;
+    return table;
+}
+
+constexpr auto ESCAPE_TABLE = MakeEscapeTable();
+
+} // namespace
+
+// ---------- Writer ------------------
+
+void Writer::WriteEscaped(std::string_view text) {
+    // неэкранируемые участки дописываются целиком
+    size_t begin = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const auto replacement = ESCAPE_TABLE[static_cast<unsigned char>(text[i])];
+        if (!replacement.empty()) {
+            buffer_.append(text.substr(begin, i - begin));
+            buffer_.append(replacement);
+            begin = i + 1;
+        }
+    }
+    buffer_.append(text.substr(begin));
+}
+
 // ---------- Object ------------------
 
 void Object::Render(const RenderContext &context) const {
@@ -14,26 +47,78 @@ void Object::Render(const RenderContext &context) const {
     // Делегируем вывод тега своим подклассам
     RenderObject(context);
 
-    context.out << std::endl;
+    context.out << '\n';
 }
 
 // ---------- Document ------------------
 
 void Document::AddPtr(std::unique_ptr<Object> &&obj) {
-    objects_.push_back(std::move(obj));
+    if (dynamic_cast<const Use*>(obj.get()) != nullptr) {
+        has_links_ = true;
+    }
+    objects_.emplace_back(std::move(obj));
+}
+
+void Document::AddShape(Circle &&circle) {
+    objects_.emplace_back(std::move(circle));
+}
+
+void Document::AddShape(Polyline &&polyline) {
+    objects_.emplace_back(std::move(polyline));
+}
+
+void Document::AddShape(Text &&text) {
+    objects_.emplace_back(std::move(text));
+}
+
+template <typename Shape>
+void Document::RenderShape(const Shape &shape, const RenderContext &context) {
+    // тип фигуры известен статически, поэтому RenderObject вызывается без виртуальной диспетчеризации
+    context.RenderIndent();
+    shape.RenderObject(context);
+    context.out << '\n';
+}
+
+void Document::RenderShape(const std::unique_ptr<Object> &object, const RenderContext &context) {
+    object->Render(context);
+}
+
+void Document::Render(std::ostream &out, const number_format::Settings &number_format) const {
+    std::string buffer;
+    Render(buffer, number_format);
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
 }
 
-void Document::Render(std::ostream &out) const {
+void Document::Render(std::string &out, const number_format::Settings &number_format) const {
+    RenderBegin(out, has_links_);
+    RenderObjects(out, number_format);
+    RenderEnd(out);
+}
+
+void Document::RenderBegin(std::string &out, bool xlink) {
     // выводим шапку документа
-    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+    out += "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+    if (xlink) {
+        out += "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" version=\"1.1\">\n"sv;
+    } else {
+        out += "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+    }
+}
+
+void Document::RenderObjects(std::string &out, const number_format::Settings &number_format) const {
+    Writer writer(out);
     // выводим все объекты
-    RenderContext ctx(out, 2, 2);
+    RenderContext ctx(writer, 2, 2, number_format);
     for (const auto &object : objects_) {
-        object->Render(ctx);
+        std::visit([&ctx](const auto &shape) {
+            RenderShape(shape, ctx);
+        }, object);
     }
+}
+
+void Document::RenderEnd(std::string &out) {
     // выводим закрывающий тег
-    out << "</svg>"sv;
+    out += "</svg>"sv;
 }
 
 // ---------- Circle ------------------
@@ -50,9 +135,9 @@ Circle& Circle::SetRadius(double radius)  {
 
 void Circle::RenderObject(const RenderContext &context) const {
     auto &out = context.out;
-    out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
-    out << "r=\""sv << radius_ << "\""sv;
-    RenderAttrs(out);
+    out << "<circle cx=\""sv << context.Format(center_.x) << "\" cy=\""sv << context.Format(center_.y) << "\" "sv;
+    out << "r=\""sv << context.Format(radius_) << "\""sv;
+    RenderAttrs(context);
     out << "/>"sv;
 }
 
@@ -71,13 +156,13 @@ void Polyline::RenderObject(const RenderContext &context) const {
     out << "points=\""sv;
     auto size = points_.size();
     if (size != 0) {
-        out << points_.at(0).x << ","sv << points_.at(0).y;
+        out << context.Format(points_.at(0).x) << ","sv << context.Format(points_.at(0).y);
         for (auto i = 1u; i < size; ++i) {
-            out << " " << points_.at(i).x << ","sv << points_.at(i).y;
+            out << ' ' << context.Format(points_.at(i).x) << ","sv << context.Format(points_.at(i).y);
         }
     }
     out << "\""sv;
-    RenderAttrs(out);
+    RenderAttrs(context);
     // закрываем тег
     out << "/>"sv;
 }
@@ -119,12 +204,12 @@ void Text::RenderObject(const RenderContext &context) const {
     // открываем тег
     out << "<text"sv;
     // пишем свойства
-    RenderAttrs(out);
-    out << " x=\""sv << pos_.x << "\" "sv;
-    out << "y=\""sv << pos_.y << "\" "sv;
-    out << "dx=\""sv << offset_.x << "\" "sv;
-    out << "dy=\""sv << offset_.y << "\" "sv;
-    out << "font-size=\""sv << font_size_ << "\""sv;
+    RenderAttrs(context);
+    out << " x=\""sv << context.Format(pos_.x) << "\" "sv;
+    out << "y=\""sv << context.Format(pos_.y) << "\" "sv;
+    out << "dx=\""sv << context.Format(offset_.x) << "\" "sv;
+    out << "dy=\""sv << context.Format(offset_.y) << "\" "sv;
+    out << "font-size=\""sv << static_cast<int>(font_size_) << "\""sv;
     if (font_family_) {
         out << " font-family=\""sv << font_family_.value() << "\""sv;
     }
@@ -134,78 +219,154 @@ void Text::RenderObject(const RenderContext &context) const {
     // закрываем тег
     out << ">"sv;
     // пишем текст
-    out << EscapeText(data_);
+    out.WriteEscaped(data_);
     // закрывающий тег текста
     out << "</text>"sv;
 }
 
-std::string Text::EscapeText(const std::string &text) {
-    // экранирующие значения для спецсимволов
-    std::unordered_map<char, std::string> characters = {{34,"&quot;"s},
-                                                        {38,"&amp;"s},
-                                                        {39,"&apos;"s},
-                                                        {60,"&lt;"s},
-                                                        {62,"&gt;"s}};
-    std::string result;
-    // проходим по всем символам строки, если это спецсимвол - экранируем
-    for (auto c : text) {
-        auto iter = characters.find(c);
-        if (iter != characters.end()) {
-            result += iter->second;
-        } else {
-            result += c;
-        }
+// ---------- Label ------------------
+
+Label& Label::SetPosition(Point pos) {
+    pos_ = pos;
+    return *this;
+}
+
+Label& Label::SetData(std::string data) {
+    data_ = std::move(data);
+    return *this;
+}
+
+void Label::RenderObject(const RenderContext &context) const {
+    auto &out = context.out;
+    out << "<text"sv;
+    RenderAttrs(context);
+    out << " x=\""sv << context.Format(pos_.x) << "\" y=\""sv << context.Format(pos_.y) << "\">"sv;
+    out.WriteEscaped(data_);
+    out << "</text>"sv;
+}
+
+// ---------- Rect ------------------
+
+Rect& Rect::SetPosition(Point pos) {
+    pos_ = pos;
+    return *this;
+}
+
+Rect& Rect::SetSize(Point size) {
+    size_ = size;
+    return *this;
+}
+
+void Rect::RenderObject(const RenderContext &context) const {
+    auto &out = context.out;
+    out << "<rect x=\""sv << context.Format(pos_.x) << "\" y=\""sv << context.Format(pos_.y)
+        << "\" width=\""sv << context.Format(size_.x) << "\" height=\""sv << context.Format(size_.y) << "\""sv;
+    RenderAttrs(context);
+    out << "/>"sv;
+}
+
+// ---------- Use ------------------
+
+Use& Use::SetHref(std::string id) {
+    href_ = std::move(id);
+    return *this;
+}
+
+Use& Use::SetPosition(Point pos) {
+    pos_ = pos;
+    return *this;
+}
+
+void Use::RenderObject(const RenderContext &context) const {
+    auto &out = context.out;
+    out << "<use xlink:href=\"#"sv << href_ << "\" x=\""sv << context.Format(pos_.x)
+        << "\" y=\""sv << context.Format(pos_.y) << "\""sv;
+    RenderAttrs(context);
+    out << "/>"sv;
+}
+
+// ---------- Style ------------------
+
+Style& Style::SetContent(std::string content) {
+    content_ = std::move(content);
+    return *this;
+}
+
+void Style::RenderObject(const RenderContext &context) const {
+    auto &out = context.out;
+    out << "<style>"sv;
+    out.WriteEscaped(content_);
+    out << "</style>"sv;
+}
+
+// ---------- Defs ------------------
+
+void Defs::AddPtr(std::unique_ptr<Object> &&obj) {
+    objects_.push_back(std::move(obj));
+}
+
+void Defs::RenderObject(const RenderContext &context) const {
+    auto &out = context.out;
+    out << "<defs>\n"sv;
+    const auto inner = context.Indented();
+    for (const auto &object : objects_) {
+        object->Render(inner);
     }
-    return result;
+    context.RenderIndent();
+    out << "</defs>"sv;
 }
 
-std::string TagStrokeLineCap(StrokeLineCap line_cap) {
-    std::string result;
+std::string_view TagStrokeLineCap(StrokeLineCap line_cap) {
     switch(line_cap) {
     case StrokeLineCap::BUTT:
-        result = "butt"s;
-        break;
+        return "butt"sv;
     case StrokeLineCap::ROUND:
-        result = "round"s;
-        break;
+        return "round"sv;
     case StrokeLineCap::SQUARE:
-        result = "square"s;
-        break;
+        return "square"sv;
     }
-    return result;
+    return {};
 }
 
-std::string TagStrokeLineJoin(StrokeLineJoin line_join) {
-    std::string result;
+std::string_view TagStrokeLineJoin(StrokeLineJoin line_join) {
     switch(line_join) {
     case StrokeLineJoin::ARCS:
-        result = "arcs"s;
-        break;
+        return "arcs"sv;
     case StrokeLineJoin::BEVEL:
-        result = "bevel"s;
-        break;
+        return "bevel"sv;
     case StrokeLineJoin::MITER:
-        result = "miter"s;
-        break;
+        return "miter"sv;
     case StrokeLineJoin::MITER_CLIP:
-        result = "miter-clip"s;
-        break;
+        return "miter-clip"sv;
     case StrokeLineJoin::ROUND:
-        result = "round"s;
-        break;
+        return "round"sv;
     }
-    return result;
+    return {};
 }
 
-std::ostream& operator<<(std::ostream &out, Color color) {
+std::ostream& operator<<(std::ostream &out, const Color &color) {
     std::visit(OstreamColorPrinter{out}, color);
     return out;
 }
 
+void PrintColor(const RenderContext &context, const Color &color) {
+    auto &out = context.out;
+    if (const auto *name = std::get_if<std::string>(&color)) {
+        out << *name;
+    } else if (const auto *rgb = std::get_if<Rgb>(&color)) {
+        out << "rgb("sv << int(rgb->red) << ',' << int(rgb->green) << ',' << int(rgb->blue) << ')';
+    } else if (const auto *rgba = std::get_if<Rgba>(&color)) {
+        out << "rgba("sv << int(rgba->red) << ',' << int(rgba->green) << ',' << int(rgba->blue) << ','
+            << context.Format(rgba->opacity) << ')';
+    } else {
+        out << "none"sv;
+    }
+}
+
 void OstreamColorPrinter::operator()(std::monostate) const {
     out << "none"sv;
 }
-void OstreamColorPrinter::operator()(std::string color) const {
+void OstreamColorPrinter::operator()(const std::string &color) const {
     out << color;
 }
 void OstreamColorPrinter::operator()(Rgb color) const {
@@ -214,7 +375,7 @@ void OstreamColorPrinter::operator()(Rgb color) const {
 }
 void OstreamColorPrinter::operator()(Rgba color) const {
     out << "rgba("sv << int(color.red) << ","sv << int(color.green)
-        << ","sv << int(color.blue) << ","sv << color.opacity << ")"sv;
+        << ","sv << int(color.blue) << ","sv << number_format::Formatted{color.opacity, number_format} << ")"sv;
 }
 
 }  // namespace svg
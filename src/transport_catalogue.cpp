@@ -12,6 +12,7 @@ namespace transport_catalogue {
 void TransportCatalogue::AddStop(domain::Stop stop) noexcept {
     stops_.push_back(move(stop));
     stops_by_names_.insert({stops_.back().name, &stops_.back()});
+    ++version_;
 }
 
 void TransportCatalogue::AddStop(const std::string &stop_name, geo::Coordinates coordinate) {
@@ -30,6 +31,7 @@ void TransportCatalogue::AddRoute(domain::Route route) noexcept {
     for (auto stop : routes_.back().stops) {
         buses_on_stops_[stop->name].insert(route_name);
     }
+    ++version_;
 }
 
 void TransportCatalogue::
@@ -54,6 +56,52 @@ void TransportCatalogue::SetDistance(const std::string &stop_from, const std::st
     auto Stop_from = FindStop(stop_from);
     auto Stop_to = FindStop(stop_to);
     distances_[Stop_from->name][Stop_to->name] = distance;
+    ++version_;
+}
+
+void TransportCatalogue::SetStopCoordinates(const std::string &stop_name, geo::Coordinates coordinate) {
+    // остановки в хранилище не константны, константность указателей индекса - защита от изменений извне
+    const_cast<domain::Stop*>(FindStop(stop_name))->coordinate = coordinate;
+    ++version_;
+}
+
+void TransportCatalogue::RemoveRoute(const std::string &route_name) {
+    auto route = FindRoute(route_name);
+    // убираем автобус из списков остановок; остановки без автобусов не хранятся в buses_on_stops_
+    for (auto stop : route->stops) {
+        auto buses = buses_on_stops_.find(stop->name);
+        if (buses != buses_on_stops_.end()) {
+            buses->second.erase(route->name);
+            if (buses->second.empty()) {
+                buses_on_stops_.erase(buses);
+            }
+        }
+    }
+    routes_by_names_.erase(route->name);
+    ++version_;
+}
+
+void TransportCatalogue::RemoveStop(const std::string &stop_name) {
+    auto stop = FindStop(stop_name);
+    if (buses_on_stops_.count(stop->name) > 0) {
+        throw std::invalid_argument("Stop "s + stop_name + " is used by routes"s);
+    }
+    distances_.erase(stop->name);
+    for (auto &[stop_from, distances] : distances_) {
+        distances.erase(stop->name);
+    }
+    stops_by_names_.erase(stop->name);
+    ++version_;
+}
+
+void TransportCatalogue::RemoveDistance(const std::string &stop_from, const std::string &stop_to) {
+    auto distances = distances_.find(stop_from);
+    if (distances != distances_.end() && distances->second.erase(stop_to) > 0) {
+        if (distances->second.empty()) {
+            distances_.erase(distances);
+        }
+        ++version_;
+    }
 }
 
 const domain::Stop* TransportCatalogue::FindStop(const string &stop_name) const {
@@ -137,6 +185,10 @@ const std::unordered_map<string_view, std::unordered_map<string_view, int> >
     return distances_;
 }
 
+uint64_t TransportCatalogue::GetVersion() const noexcept {
+    return version_;
+}
+
 int TransportCatalogue::CalculateRealRouteLength(const domain::Route *route) const {
     int result = 0;
     if (route != nullptr) {
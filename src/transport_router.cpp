@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "transport_router.h"
 
 namespace transport_router {
@@ -9,14 +11,66 @@ TransportRouter::TransportRouter(const transport_catalogue::TransportCatalogue &
 
 void TransportRouter::InitRouter() {
     // если роутер ещё не был инициализирован - делаем это
-    if (!is_initialized_) {
+    if (!is_initialized_ && loader_) {
+        // данные загружаются заранее подготовленной функцией
+        const auto loader = std::move(loader_);
+        loader_ = nullptr;
+        loader(*this);
+        is_initialized_ = true;
+        is_graph_initialized_ = true;
+    } else if (!is_initialized_) {
+        InitGraph();
+        // строим маршрутизатор
+        if (checkpoints_.save) {
+            BuildRouterWithCheckpoints();
+        } else {
+            router_ = std::make_unique<graph::Router<RouteWeight>>(graph_);
+        }
+        is_initialized_ = true;
+    }
+}
+
+void TransportRouter::BuildRouterWithCheckpoints() {
+    using Clock = std::chrono::steady_clock;
+
+    router_ = std::make_unique<Router>(graph_, false);
+    size_t next_vertex = checkpoints_.resume ? checkpoints_.resume(graph_, *router_) : 0;
+    if (next_vertex == 0) {
+        // неудачная загрузка могла частично заполнить таблицу (очищается на месте, без второй копии)
+        for (auto &row : router_->GetRoutesInternalData()) {
+            std::fill(row.begin(), row.end(), std::nullopt);
+        }
+        router_->InitializeRoutes();
+    }
+
+    const size_t vertex_count = graph_.GetVertexCount();
+    auto interval = checkpoints_.interval;
+    auto last_save = Clock::now();
+    while (next_vertex < vertex_count) {
+        router_->RelaxRoutes(next_vertex, next_vertex + 1);
+        ++next_vertex;
+        if (next_vertex < vertex_count && Clock::now() - last_save >= interval) {
+            const auto save_start = Clock::now();
+            checkpoints_.save(graph_, *router_, next_vertex);
+            last_save = Clock::now();
+            // сохранение большой таблицы может быть долгим: интервал растёт так, чтобы сохранения
+            // занимали не больше max_overhead времени построения
+            if (checkpoints_.max_overhead > 0) {
+                const auto min_interval = std::chrono::duration_cast<Clock::duration>(
+                        (last_save - save_start) / checkpoints_.max_overhead);
+                interval = std::max(checkpoints_.interval, min_interval);
+            }
+        }
+    }
+}
+
+void TransportRouter::InitGraph() {
+    if (!is_graph_initialized_) {
         graph::DirectedWeightedGraph<RouteWeight>graph(CountStops());
         graph_ = std::move(graph);
         // записываем маршруты в граф
         BuildEdges();
-        // строим маршрутизатор
-        router_ = std::make_unique<graph::Router<RouteWeight>>(graph_);
-        is_initialized_ = true;
+        is_graph_initialized_ = true;
     }
 }
 
@@ -27,9 +81,13 @@ TransportRouter::BuildRoute(const std::string &from, const std::string &to) {
         return TransportRoute{};
     }
     InitRouter();
-    auto from_id = id_by_stop_name_.at(from);
-    auto to_id = id_by_stop_name_.at(to);
-    auto route = router_->BuildRoute(from_id, to_id);
+    // неизвестная остановка - маршрут не найден
+    const auto from_id = id_by_stop_name_.find(from);
+    const auto to_id = id_by_stop_name_.find(to);
+    if (from_id == id_by_stop_name_.end() || to_id == id_by_stop_name_.end()) {
+        return std::nullopt;
+    }
+    auto route = router_->BuildRoute(from_id->second, to_id->second);
     if (!route) {
         return std::nullopt;
     }
@@ -57,8 +115,18 @@ TransportRouter::RoutingSettings& TransportRouter::GetSettings() {
     return settings_;
 }
 
+void TransportRouter::SetLoader(Loader loader) {
+    loader_ = std::move(loader);
+    is_initialized_ = false;
+}
+
+void TransportRouter::SetCheckpoints(Checkpoints checkpoints) {
+    checkpoints_ = std::move(checkpoints);
+}
+
 void TransportRouter::InternalInit() {
     is_initialized_ = true;
+    is_graph_initialized_ = true;
 }
 
 TransportRouter::Graph& TransportRouter::GetGraph() {